@@ -2,71 +2,437 @@
 #ifndef BVH_H
 #define BVH_H
 
+#include <algorithm>
+#include <cstdint>
+#include <limits>
 #include <vector>
 #include "Sphere.h"
+#include "Cylinder.h"
+#include "Triangle.h"
 #include "AABB.h"
-#include "hit_record.h"
+#include "arena.h"
+#include "render_stats.h"
+#include "trace.h"
 
+enum PrimitiveType : uint32_t {
+    PRIMITIVE_SPHERE,
+    PRIMITIVE_CYLINDER,
+    PRIMITIVE_TRIANGLE
+};
+
+// Which primitive a BVH leaf entry refers to: an index into the scene's
+// spheres, cylinders or triangles vector
+struct PrimitiveRef {
+    uint32_t type;
+    uint32_t index;
+};
+
+// Refitted BVHs are rebuilt once their boxes have this much more surface area than
+// right after the build, a tree that loose costs more than the build saves
+const float bvhRebuildGrowth = 1.5f;
+
+struct BVHHit {
+    float t;
+    PrimitiveRef primitive;
+};
+
+// Nodes live in the BVH's arena. Inner nodes have both children set, leaves
+// cover primitives [first, first + count) of BVH::primitives. box bounds the
+// primitives when the shutter opens and boxEnd when it closes; in between, the box
+// interpolated between the two bounds them too, as every primitive moves in a straight
+// line (for a BVH without motion both are the same and only box is read).
 class BVHNode {
 public:
     AABB box;
+    AABB boxEnd;
     BVHNode* left;
     BVHNode* right;
-    Sphere* sphere;
+    uint32_t first;
+    uint32_t count;
 
-    BVHNode();
-    BVHNode(const std::vector<Sphere*>& spheres, size_t start, size_t end);
+    BVHNode() : left(nullptr), right(nullptr), first(0), count(0) {}
 
-    bool intersect(const Ray& ray, float& t) const;
+    AABB boxAt(float time) const {
+        return AABB(box.min + (boxEnd.min - box.min) * time, box.max + (boxEnd.max - box.max) * time);
+    }
 };
 
 class BVH {
 public:
-    BVH(const std::vector<Sphere*>& spheres);
-    bool intersect(const Ray& ray, float& t) const;
+    BVH() : nodes(256 * 1024), root(nullptr), nodeCount(0), builtArea(0.0f), moving(false) {}
+
+    // Copies clone the node tree into the new BVH's own arena
+    BVH(const BVH& other) : nodes(other.nodes.defaultBlockSize()), root(nullptr),
+                            primitives(other.primitives), nodeCount(0), builtArea(other.builtArea),
+                            moving(other.moving) {
+        root = cloneNode(other.root);
+    }
+
+    BVH& operator=(const BVH& other) {
+        if (this != &other) {
+            nodes.reset();
+            nodeCount = 0;
+            primitives = other.primitives;
+            builtArea = other.builtArea;
+            moving = other.moving;
+            root = cloneNode(other.root);
+        }
+        return *this;
+    }
+
+    BVH(BVH&&) = default;
+    BVH& operator=(BVH&&) = default;
+
+    // (Re)build over the given primitives. The previous tree is dropped wholesale by
+    // resetting the node arena, and per-primitive build data goes to the caller's
+    // scratch arena, so rebuilding every frame stops touching the heap after warm-up.
+    void build(const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders,
+               const std::vector<Triangle>& triangles, Arena& scratch);
+
+    // Updates the boxes for primitives that moved, keeping the tree: every box is
+    // recomputed from what is under it, far cheaper than build() and allocation free.
+    // The primitives must be the ones the tree was built over. The tree gets worse the
+    // further things move from where they were at the build, so this returns the summed
+    // surface area of all boxes relative to right after the build; rebuild once it has
+    // grown well past 1.
+    float refit(const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders,
+                const std::vector<Triangle>& triangles);
+
+    // Closest hit with tMin < t < tMax, with the primitives where they are at ray.time
+    bool intersect(const Ray& ray, float tMin, float tMax,
+                   const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders,
+                   const std::vector<Triangle>& triangles, BVHHit& hit) const {
+        return moving ? closestHit<true>(ray, tMin, tMax, spheres, cylinders, triangles, hit)
+                      : closestHit<false>(ray, tMin, tMax, spheres, cylinders, triangles, hit);
+    }
+
+    // Any hit with tMin < t < tMax, for shadow rays
+    bool occluded(const Ray& ray, float tMin, float tMax,
+                  const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders,
+                  const std::vector<Triangle>& triangles) const {
+        return moving ? anyHit<true>(ray, tMin, tMax, spheres, cylinders, triangles)
+                      : anyHit<false>(ray, tMin, tMax, spheres, cylinders, triangles);
+    }
+
+    // Whether some primitive moves while the shutter is open (see Sphere::setShutterClose())
+    bool hasMotion() const {
+        return moving;
+    }
+
+    const ArenaStats& arenaStats() const {
+        return nodes.stats();
+    }
+
+    size_t size() const {
+        return nodeCount;
+    }
+
+    // Box around everything over the whole shutter, empty when nothing was built
+    AABB bounds() const {
+        return root != nullptr ? AABB::surroundingBox(root->box, root->boxEnd) : AABB();
+    }
 
 private:
+    struct BuildEntry {
+        AABB box;
+        AABB boxEnd;
+        Vec3 centroid;  // of both boxes together, moving primitives are split by where they sweep
+        PrimitiveRef ref;
+    };
+
+    static const uint32_t maxLeafSize = 4;
+    static const int maxDepth = 64;
+
+    Arena nodes;
     BVHNode* root;
-};
+    std::vector<PrimitiveRef> primitives;
+    size_t nodeCount;
+    float builtArea;  // summed box surface area after the last build
+    bool moving;      // traversal interpolates the node boxes to the ray's time
 
-BVHNode::BVHNode() : left(nullptr), right(nullptr), sphere(nullptr) {}
+    BVHNode* buildNode(BuildEntry* entries, uint32_t start, uint32_t end, int depth);
+    BVHNode* cloneNode(const BVHNode* node);
+    void refitNode(BVHNode* node, const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders,
+                   const std::vector<Triangle>& triangles, float& area);
 
-BVHNode::BVHNode(const std::vector<Sphere*>& spheres, size_t start, size_t end) {
-    for (size_t i = start; i < end; ++i) {
-        if (i == start) {
-            box = spheres[i]->getBoundingBox();
-        } else {
-            box = AABB::surroundingBox(box, spheres[i]->getBoundingBox());
+    template <bool Moving>
+    bool closestHit(const Ray& ray, float tMin, float tMax,
+                    const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders,
+                    const std::vector<Triangle>& triangles, BVHHit& hit) const;
+
+    template <bool Moving>
+    bool anyHit(const Ray& ray, float tMin, float tMax,
+                const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders,
+                const std::vector<Triangle>& triangles) const;
+
+    // A BVH without motion tests the boxes exactly as they are
+    template <bool Moving>
+    static bool hitsBox(const BVHNode* node, const Ray& ray, float tMin, float tMax) {
+        return Moving ? node->boxAt(ray.time).intersect(ray, tMin, tMax) : node->box.intersect(ray, tMin, tMax);
+    }
+
+    // Same padding build() gives every primitive, so flat primitives (axis aligned
+    // triangles) still get hit
+    static AABB paddedBox(const AABB& box) {
+        const Vec3 padding(1e-4f, 1e-4f, 1e-4f);
+        return AABB(box.min - padding, box.max + padding);
+    }
+
+    static float surfaceArea(const AABB& box) {
+        Vec3 d = box.max - box.min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    // Padded boxes of a primitive when the shutter opens and closes, returns whether it moves
+    template <typename Primitive>
+    static bool primitiveBoxes(const Primitive& primitive, AABB& box, AABB& boxEnd) {
+        box = paddedBox(primitive.getBoundingBox());
+        boxEnd = primitive.isMoving() ? paddedBox(primitive.getBoundingBoxEnd()) : box;
+        return primitive.isMoving();
+    }
+
+    static bool primitiveBoxes(const PrimitiveRef& primitive, const std::vector<Sphere>& spheres,
+                               const std::vector<Cylinder>& cylinders, const std::vector<Triangle>& triangles,
+                               AABB& box, AABB& boxEnd) {
+        switch (primitive.type) {
+            case PRIMITIVE_SPHERE: return primitiveBoxes(spheres[primitive.index], box, boxEnd);
+            case PRIMITIVE_CYLINDER: return primitiveBoxes(cylinders[primitive.index], box, boxEnd);
+            default: return primitiveBoxes(triangles[primitive.index], box, boxEnd);
+        }
+    }
+
+    static float axisValue(const Vec3& v, int axis) {
+        return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+    }
+
+    static bool intersectPrimitive(const PrimitiveRef& primitive, const Ray& ray, float& t,
+                                   const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders,
+                                   const std::vector<Triangle>& triangles) {
+        switch (primitive.type) {
+            case PRIMITIVE_SPHERE: return spheres[primitive.index].intersect(ray, t);
+            case PRIMITIVE_CYLINDER: return cylinders[primitive.index].intersect(ray, t);
+            default: return triangles[primitive.index].intersect(ray, t);
         }
     }
+};
+
+inline void BVH::build(const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders,
+                       const std::vector<Triangle>& triangles, Arena& scratch) {
+    nodes.reset();
+    root = nullptr;
+    nodeCount = 0;
+    builtArea = 0.0f;
+    moving = false;
+
+    size_t count = spheres.size() + cylinders.size() + triangles.size();
+    primitives.resize(count);
+    if (count == 0) {
+        return;
+    }
+
+    BuildEntry* entries = scratch.allocateArray<BuildEntry>(count);
+    {
+        TRACE_SCOPE("bvh entries", "build");
+        size_t n = 0;
+        auto addEntry = [&](const auto& primitive, uint32_t type, size_t index) {
+            BuildEntry& entry = entries[n++];
+            if (primitiveBoxes(primitive, entry.box, entry.boxEnd)) {
+                moving = true;
+                AABB swept = AABB::surroundingBox(entry.box, entry.boxEnd);
+                entry.centroid = (swept.min + swept.max) * 0.5f;
+            } else {
+                entry.centroid = (entry.box.min + entry.box.max) * 0.5f;
+            }
+            entry.ref.type = type;
+            entry.ref.index = static_cast<uint32_t>(index);
+        };
+        for (size_t i = 0; i < spheres.size(); ++i) addEntry(spheres[i], PRIMITIVE_SPHERE, i);
+        for (size_t i = 0; i < cylinders.size(); ++i) addEntry(cylinders[i], PRIMITIVE_CYLINDER, i);
+        for (size_t i = 0; i < triangles.size(); ++i) addEntry(triangles[i], PRIMITIVE_TRIANGLE, i);
+    }
+
+    {
+        TRACE_SCOPE("bvh nodes", "build");
+        root = buildNode(entries, 0, static_cast<uint32_t>(count), 0);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        primitives[i] = entries[i].ref;
+    }
 
-    if (end - start > 1) {
-        size_t mid = (start + end) / 2;
-        left = new BVHNode(spheres, start, mid);
-        right = new BVHNode(spheres, mid, end);
+}
+
+inline float BVH::refit(const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders,
+                        const std::vector<Triangle>& triangles) {
+    if (root == nullptr) {
+        return 1.0f;
+    }
+    TRACE_SCOPE("bvh refit", "build");
+    float area = 0.0f;
+    moving = false;
+    refitNode(root, spheres, cylinders, triangles, area);
+    return builtArea > 0.0f ? area / builtArea : 1.0f;
+}
+
+inline void BVH::refitNode(BVHNode* node, const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders,
+                           const std::vector<Triangle>& triangles, float& area) {
+    if (node->left == nullptr) {
+        for (uint32_t i = node->first; i < node->first + node->count; ++i) {
+            AABB box, boxEnd;
+            if (primitiveBoxes(primitives[i], spheres, cylinders, triangles, box, boxEnd)) {
+                moving = true;
+            }
+            node->box = i == node->first ? box : AABB::surroundingBox(node->box, box);
+            node->boxEnd = i == node->first ? boxEnd : AABB::surroundingBox(node->boxEnd, boxEnd);
+        }
     } else {
-        sphere = spheres[start];
+        refitNode(node->left, spheres, cylinders, triangles, area);
+        refitNode(node->right, spheres, cylinders, triangles, area);
+        node->box = AABB::surroundingBox(node->left->box, node->right->box);
+        node->boxEnd = AABB::surroundingBox(node->left->boxEnd, node->right->boxEnd);
     }
+    area += surfaceArea(AABB::surroundingBox(node->box, node->boxEnd));
 }
 
-bool BVHNode::intersect(const Ray& ray, HitRecord& hitRecord) const {
-    if (!box.intersect(ray)) {
-        return false;
+inline BVHNode* BVH::buildNode(BuildEntry* entries, uint32_t start, uint32_t end, int depth) {
+    BVHNode* node = nodes.create<BVHNode>();
+    ++nodeCount;
+
+    node->box = entries[start].box;
+    node->boxEnd = entries[start].boxEnd;
+    Vec3 centroidMin = entries[start].centroid;
+    Vec3 centroidMax = entries[start].centroid;
+    for (uint32_t i = start + 1; i < end; ++i) {
+        node->box = AABB::surroundingBox(node->box, entries[i].box);
+        node->boxEnd = AABB::surroundingBox(node->boxEnd, entries[i].boxEnd);
+        centroidMin = Vec3(std::min(centroidMin.x, entries[i].centroid.x), std::min(centroidMin.y, entries[i].centroid.y),
+                           std::min(centroidMin.z, entries[i].centroid.z));
+        centroidMax = Vec3(std::max(centroidMax.x, entries[i].centroid.x), std::max(centroidMax.y, entries[i].centroid.y),
+                           std::max(centroidMax.z, entries[i].centroid.z));
+    }
+    builtArea += surfaceArea(AABB::surroundingBox(node->box, node->boxEnd));  // the baseline for refit()
+
+    // Split along the axis where the centroids spread the most
+    Vec3 extent = centroidMax - centroidMin;
+    int axis = 0;
+    if (extent.y > extent.x) axis = 1;
+    if (extent.z > axisValue(extent, axis)) axis = 2;
+
+    if (end - start <= maxLeafSize || depth >= maxDepth || axisValue(extent, axis) <= 0.0f) {
+        node->first = start;
+        node->count = end - start;
+        return node;
     }
 
-    bool hitLeft = left != nullptr ? left->intersect(ray, hitRecord) : false;
-    bool hitRight = right != nullptr ? right->intersect(ray, hitRecord) : false;
+    // Median split
+    uint32_t mid = start + (end - start) / 2;
+    std::nth_element(entries + start, entries + mid, entries + end,
+                     [axis](const BuildEntry& a, const BuildEntry& b) {
+                         return axisValue(a.centroid, axis) < axisValue(b.centroid, axis);
+                     });
 
-    return hitLeft || hitRight;
+    node->left = buildNode(entries, start, mid, depth + 1);
+    node->right = buildNode(entries, mid, end, depth + 1);
+    return node;
 }
 
+inline BVHNode* BVH::cloneNode(const BVHNode* node) {
+    if (node == nullptr) {
+        return nullptr;
+    }
+    BVHNode* copy = nodes.create<BVHNode>(*node);
+    ++nodeCount;
+    copy->left = cloneNode(node->left);
+    copy->right = cloneNode(node->right);
+    return copy;
+}
+
+template <bool Moving>
+inline bool BVH::closestHit(const Ray& ray, float tMin, float tMax,
+                            const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders,
+                            const std::vector<Triangle>& triangles, BVHHit& hit) const {
+    if (root == nullptr) {
+        return false;
+    }
+
+    // Counted locally and published once, the traversal loop stays free of stores
+    uint64_t boxTests = 0, primitiveTests = 0;
+    bool found = false;
+    float closest = tMax;
+    const BVHNode* stack[maxDepth + 1];
+    int top = 0;
+    stack[top++] = root;
+
+    while (top > 0) {
+        const BVHNode* node = stack[--top];
+        ++boxTests;
+        if (!hitsBox<Moving>(node, ray, tMin, closest)) {
+            continue;
+        }
+
+        if (node->left == nullptr) {
+            for (uint32_t i = node->first; i < node->first + node->count; ++i) {
+                float t;
+                ++primitiveTests;
+                if (intersectPrimitive(primitives[i], ray, t, spheres, cylinders, triangles) && t > tMin && t < closest) {
+                    closest = t;
+                    hit.t = t;
+                    hit.primitive = primitives[i];
+                    found = true;
+                }
+            }
+        } else {
+            stack[top++] = node->right;
+            stack[top++] = node->left;
+        }
+    }
 
-BVH::BVH(const std::vector<Sphere*>& spheres) {
-    root = new BVHNode(spheres, 0, spheres.size());
+    RenderCounters& counters = RenderStats::local();
+    counters.boxTests += boxTests;
+    counters.primitiveTests += primitiveTests;
+    return found;
 }
 
-bool BVH::intersect(const Ray& ray, float& t) const {
-    return root->intersect(ray, t);
+template <bool Moving>
+inline bool BVH::anyHit(const Ray& ray, float tMin, float tMax,
+                        const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders,
+                        const std::vector<Triangle>& triangles) const {
+    if (root == nullptr) {
+        return false;
+    }
+
+    uint64_t boxTests = 0, primitiveTests = 0;
+    bool occluded = false;
+    const BVHNode* stack[maxDepth + 1];
+    int top = 0;
+    stack[top++] = root;
+
+    while (top > 0 && !occluded) {
+        const BVHNode* node = stack[--top];
+        ++boxTests;
+        if (!hitsBox<Moving>(node, ray, tMin, tMax)) {
+            continue;
+        }
+
+        if (node->left == nullptr) {
+            for (uint32_t i = node->first; i < node->first + node->count; ++i) {
+                float t;
+                ++primitiveTests;
+                if (intersectPrimitive(primitives[i], ray, t, spheres, cylinders, triangles) && t > tMin && t < tMax) {
+                    occluded = true;
+                    break;
+                }
+            }
+        } else {
+            stack[top++] = node->right;
+            stack[top++] = node->left;
+        }
+    }
+
+    RenderCounters& counters = RenderStats::local();
+    counters.boxTests += boxTests;
+    counters.primitiveTests += primitiveTests;
+    return occluded;
 }
 
 #endif // BVH_H
@@ -9,6 +9,8 @@
 #include <string>
 #include <iostream>
 #include "color.h"
+#include "render_stats.h"
+#include "trace.h"
 
 
 class ImageTexture {
@@ -22,7 +24,7 @@ public:
     ImageTexture() : data(nullptr), width(0), height(0), channels(0) {}
     ImageTexture(const std::string& filename) : data(nullptr), width(0), height(0), channels(0) {
         // Load image using stb_image library
-
+        TRACE_SCOPE("texture load", "io");
         data = stbi_load(filename.c_str(), &width, &height, &channels, 0);
 
 
@@ -45,6 +47,7 @@ ImageTexture(const nlohmann::json& materialJson) : data(nullptr), width(0), heig
             
             std::cout << "Loading image: " << filename << std::endl;
             // Load image using stb_image library
+            TRACE_SCOPE("texture load", "io");
             data = stbi_load(filename.c_str(), &width, &height, &channels, 0);
 
         // Check for errors
@@ -87,6 +90,7 @@ Color getPixel(int x, int y) const {
 
     // Sample texture color at given UV coordinates
   Vec3 sample(float u, float v) const {
+    ++RenderStats::local().textureSamples;
     // Debugging output
    // std::cout << "Sampling texture at UV coordinates: (" << u << ", " << v << ")" << std::endl;
     u = std::clamp(u, 0.0f, 1.0f);
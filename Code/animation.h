@@ -0,0 +1,221 @@
+// animation.h
+//
+// An animation is rendered as a sequence of independent scene snapshots: a frame's
+// snapshot is the base scene with the animated objects moved to where they are in that
+// frame. Nothing is shared between snapshots but the read-only base scene, so several
+// frames can be built and rendered at the same time. A Motion says where things are:
+// the keyframes from the scene file (KeyframeMotion) or, for scenes without any, the
+// bobbing sphere and cylinder the renderer has always shown (BobbingMotion). With motion
+// blur a snapshot also holds where everything is when the shutter closes, some part of
+// a frame later (Motion::applyShutter()).
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include "AABB.h"
+#include "Vec3.h"
+#include "scene.h"
+
+// Helper function to clamp the y-coordinate of an object's position within a specified range
+inline Vec3 clampPosition(const Vec3& position, float minY, float maxY) {
+    Vec3 clampedPosition = position;
+    clampedPosition.y = std::max(minY, std::min(maxY, position.y));
+    return clampedPosition;
+}
+
+// Copies what the renderer reads, everything but the BVH and the tracks, into a
+// snapshot. Assigning the vectors reuses their storage, so a snapshot that is refilled
+// every frame stops allocating after the first.
+inline void copySceneContents(const Scene& from, Scene& to) {
+    to.cameras = from.cameras;
+    to.spheres = from.spheres;
+    to.cylinders = from.cylinders;
+    to.triangles = from.triangles;
+    to.materials = from.materials;
+    to.lights = from.lights;
+    to.backgroundColor = from.backgroundColor;
+    to.nbounces = from.nbounces;
+    to.rendermode = from.rendermode;
+    to.motionBlur = from.motionBlur;
+}
+
+// Boxes of the primitives that moved between two snapshots of the same scene, where
+// they were and where they are. Compared by bounds, which is all the motions change,
+// with motion blur at both ends of the shutter, and a box covers the whole shutter. A
+// camera that moved changes every ray, that is one box around everything.
+inline std::vector<AABB> changedBounds(const Scene& before, const Scene& after) {
+    std::vector<AABB> boxes;
+    for (size_t i = 0; i < before.cameras.size(); ++i) {
+        const PinholeCamera& a = before.cameras[i];
+        const PinholeCamera& b = after.cameras[i];
+        if (a.position.x != b.position.x || a.position.y != b.position.y || a.position.z != b.position.z ||
+            a.lookAt.x != b.lookAt.x || a.lookAt.y != b.lookAt.y || a.lookAt.z != b.lookAt.z) {
+            const float huge = std::numeric_limits<float>::max();
+            boxes.push_back(AABB(Vec3(-huge, -huge, -huge), Vec3(huge, huge, huge)));
+            return boxes;
+        }
+    }
+    auto differs = [](const AABB& a, const AABB& b) {
+        return a.min != b.min || a.max != b.max;
+    };
+    auto compare = [&](const auto& a, const auto& b) {
+        AABB boxA = a.getBoundingBox(), boxB = b.getBoundingBox();
+        AABB endA = a.getBoundingBoxEnd(), endB = b.getBoundingBoxEnd();
+        if (differs(boxA, boxB) || differs(endA, endB)) {
+            boxes.push_back(AABB::surroundingBox(boxA, endA));
+            boxes.push_back(AABB::surroundingBox(boxB, endB));
+        }
+    };
+    for (size_t i = 0; i < before.spheres.size(); ++i) {
+        compare(before.spheres[i], after.spheres[i]);
+    }
+    for (size_t i = 0; i < before.cylinders.size(); ++i) {
+        compare(before.cylinders[i], after.cylinders[i]);
+    }
+    for (size_t i = 0; i < before.triangles.size(); ++i) {
+        compare(before.triangles[i], after.triangles[i]);
+    }
+    return boxes;
+}
+
+// Where the animated objects are in every frame
+class Motion {
+public:
+    virtual ~Motion() {}
+
+    // Moves the animated objects (and the camera) of a fresh snapshot of the base scene
+    // to their place in frame, which may lie between two frames
+    virtual void apply(Scene& snapshot, float frame) const = 0;
+
+    // apply() for a shutter that opens at frame and stays open for shutter frames: the
+    // primitives of snapshot also get where they are when it closes, for motion blur.
+    // closing is scratch for the scene at that time. snapshot may be base itself.
+    void applyShutter(Scene& snapshot, float frame, float shutter, const Scene& base, Scene& closing) const {
+        if (shutter <= 0.0f) {
+            apply(snapshot, frame);
+            return;
+        }
+        copySceneContents(base, closing);
+        apply(closing, frame + shutter);
+        apply(snapshot, frame);
+        snapshot.setShutterClose(closing);
+    }
+
+    // changedBounds() from each of numFrames frames to the next, see TemporalReuse
+    std::vector<std::vector<AABB>> frameChanges(const Scene& base, int numFrames, float shutter = 0.0f) const {
+        std::vector<std::vector<AABB>> changes(std::max(numFrames, 0));
+        Scene previous, current, closing;
+        copySceneContents(base, previous);
+        applyShutter(previous, 0.0f, shutter, base, closing);
+        for (size_t frame = 1; frame < changes.size(); ++frame) {
+            copySceneContents(base, current);
+            applyShutter(current, static_cast<float>(frame), shutter, base, closing);
+            changes[frame] = changedBounds(previous, current);
+            std::swap(previous, current);
+        }
+        return changes;
+    }
+};
+
+// The keyframe tracks of the scene file, frame n of the animation is keyframe time n.
+// Every track's transform is worked out once per frame and applied to its primitives.
+class KeyframeMotion : public Motion {
+public:
+    explicit KeyframeMotion(const Scene& base) : tracks(base.tracks), cameraTrack(base.cameraTrack) {}
+
+    void apply(Scene& snapshot, float time) const override {
+        for (const ObjectTrack& track : tracks) {
+            KeyframeTransform transform = track.at(time);
+            for (uint32_t i = track.first; i < track.first + track.count; ++i) {
+                if (track.type == PRIMITIVE_SPHERE) {
+                    // Spheres stay round, the radius takes the largest scale factor
+                    Sphere& sphere = snapshot.spheres[i];
+                    sphere.center = transform.applyToPoint(sphere.center);
+                    sphere.radius *= transform.largestScale;
+                } else if (track.type == PRIMITIVE_CYLINDER) {
+                    // So do cylinders, base to top cap is transformed as a vector
+                    Cylinder& cylinder = snapshot.cylinders[i];
+                    Vec3 span = transform.applyToVector(cylinder.span());
+                    cylinder.center = transform.applyToPoint(cylinder.center);
+                    cylinder.setSpan(span);
+                    cylinder.radius *= transform.largestScale;
+                } else {
+                    Triangle& triangle = snapshot.triangles[i];
+                    triangle.v0 = transform.applyToPoint(triangle.v0);
+                    triangle.v1 = transform.applyToPoint(triangle.v1);
+                    triangle.v2 = transform.applyToPoint(triangle.v2);
+                }
+            }
+        }
+
+        if (!cameraTrack.empty() && !snapshot.cameras.empty()) {
+            PinholeCamera& camera = snapshot.cameras[0];
+            camera.position = cameraTrack.position.evaluate(time, camera.position);
+            camera.lookAt = cameraTrack.lookAt.evaluate(time, camera.lookAt);
+            camera.initialize();
+        }
+    }
+
+private:
+    std::vector<ObjectTrack> tracks;
+    CameraTrack cameraTrack;
+};
+
+// The motion renderImagesWithMovingObjects has always shown: the first sphere and the
+// first cylinder bob along y in opposite directions within [minY, maxY], and the sphere
+// swaps direction once it gets near the ground. That swap makes a frame depend on the
+// frames before it, so the positions of all frames are worked out up front and apply()
+// only has to look them up, and interpolate between two for a time in between.
+class BobbingMotion : public Motion {
+public:
+    BobbingMotion(const Scene& base, int numFrames) {
+        if (base.spheres.empty() || base.cylinders.empty()) {
+            throw std::runtime_error("The animation moves the first sphere and cylinder, the scene needs both");
+        }
+
+        // Define motion parameters
+        const float sphereSpeed = 0.2f;  // Speed of the sphere
+        const float cylinderSpeed = 0.1f;  // Speed of the cylinder
+        const float maxYPosition = 1.0f;
+        const float minYPosition = -0.5f;
+        const float groundHeight = minYPosition + 0.1f;  // Adjust as needed
+        bool isDescending = true;  // Flag to indicate whether the sphere is descending
+
+        Vec3 originalSpherePosition = base.spheres[0].center;
+        Vec3 originalCylinderPosition = base.cylinders[0].center;
+        for (int frame = 0; frame < numFrames; ++frame) {
+            float wave = std::sin(static_cast<float>(frame) * 0.1f);
+            Vec3 sphereOffset(0.0f, (isDescending ? -1.0f : 1.0f) * sphereSpeed * wave, 0.0f);
+            Vec3 cylinderOffset(0.0f, (isDescending ? 1.0f : -1.0f) * cylinderSpeed * wave, 0.0f);
+
+            // Keep both within the camera range and above the ground
+            sphereCenters.push_back(clampPosition(originalSpherePosition + sphereOffset, minYPosition, maxYPosition));
+            cylinderCenters.push_back(clampPosition(originalCylinderPosition + cylinderOffset, minYPosition, maxYPosition));
+
+            // Check if the sphere is about to reach the ground
+            if (isDescending && sphereCenters.back().y <= groundHeight) {
+                isDescending = false;  // Switch to ascending motion
+            }
+        }
+    }
+
+    void apply(Scene& snapshot, float frame) const override {
+        const size_t last = sphereCenters.size() - 1;
+        float clamped = std::min(std::max(frame, 0.0f), static_cast<float>(last));
+        size_t before = static_cast<size_t>(clamped);
+        size_t after = std::min(before + 1, last);
+        float t = clamped - static_cast<float>(before);
+        snapshot.spheres[0].setCenter(sphereCenters[before] + (sphereCenters[after] - sphereCenters[before]) * t);
+        snapshot.cylinders[0].setCenter(cylinderCenters[before] + (cylinderCenters[after] - cylinderCenters[before]) * t);
+    }
+
+private:
+    std::vector<Vec3> sphereCenters;
+    std::vector<Vec3> cylinderCenters;
+};
+
+#endif // ANIMATION_H
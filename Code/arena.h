@@ -0,0 +1,145 @@
+// arena.h
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Allocation counters of an Arena. heapAllocations only moves when the arena has to
+// grab a new block, so it stays flat once a repeated workload has warmed it up.
+struct ArenaStats {
+    size_t heapAllocations = 0;  // blocks requested from the heap
+    size_t bytesReserved = 0;    // capacity of all blocks held
+    size_t bytesInUse = 0;       // handed out since the last reset
+    size_t peakBytesInUse = 0;
+    size_t resets = 0;
+};
+
+// Bump allocator. Allocations are carved out of large blocks and are never freed
+// one by one: reset() releases everything at once and keeps the blocks for reuse.
+// Only trivially destructible types may live in an arena since no destructors run.
+class Arena {
+public:
+    explicit Arena(size_t blockSize = 64 * 1024) : current(0), offset(0), blockSize(blockSize) {}
+
+    ~Arena() {
+        release();
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    Arena(Arena&& other) noexcept
+        : blocks(std::move(other.blocks)), current(other.current), offset(other.offset),
+          blockSize(other.blockSize), counters(other.counters) {
+        other.blocks.clear();
+        other.current = 0;
+        other.offset = 0;
+        other.counters = ArenaStats();
+    }
+
+    Arena& operator=(Arena&& other) noexcept {
+        if (this != &other) {
+            release();
+            blocks = std::move(other.blocks);
+            current = other.current;
+            offset = other.offset;
+            blockSize = other.blockSize;
+            counters = other.counters;
+            other.blocks.clear();
+            other.current = 0;
+            other.offset = 0;
+            other.counters = ArenaStats();
+        }
+        return *this;
+    }
+
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        assert(alignment <= alignof(std::max_align_t) && (alignment & (alignment - 1)) == 0);
+
+        while (current < blocks.size()) {
+            size_t aligned = (offset + alignment - 1) & ~(alignment - 1);
+            if (aligned + size <= blocks[current].size) {
+                offset = aligned + size;
+                counters.bytesInUse += size;
+                counters.peakBytesInUse = std::max(counters.peakBytesInUse, counters.bytesInUse);
+                return blocks[current].data + aligned;
+            }
+            // Move on to the next block kept from before the last reset
+            ++current;
+            offset = 0;
+        }
+
+        // Out of blocks: get a new one, big enough for oversized requests
+        Block block;
+        block.size = std::max(blockSize, size);
+        block.data = static_cast<char*>(::operator new(block.size));
+        blocks.push_back(block);
+        current = blocks.size() - 1;
+        offset = size;
+
+        ++counters.heapAllocations;
+        counters.bytesReserved += block.size;
+        counters.bytesInUse += size;
+        counters.peakBytesInUse = std::max(counters.peakBytesInUse, counters.bytesInUse);
+        return block.data;
+    }
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    T* allocateArray(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed");
+        T* items = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        for (size_t i = 0; i < count; ++i) {
+            new (items + i) T();
+        }
+        return items;
+    }
+
+    // Forget every allocation, the blocks stay around for the next round
+    void reset() {
+        current = 0;
+        offset = 0;
+        counters.bytesInUse = 0;
+        ++counters.resets;
+    }
+
+    const ArenaStats& stats() const {
+        return counters;
+    }
+
+    size_t defaultBlockSize() const {
+        return blockSize;
+    }
+
+private:
+    struct Block {
+        char* data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t current;
+    size_t offset;
+    size_t blockSize;
+    ArenaStats counters;
+
+    void release() {
+        for (const auto& block : blocks) {
+            ::operator delete(block.data);
+        }
+        blocks.clear();
+    }
+};
+
+#endif // ARENA_H
@@ -0,0 +1,394 @@
+// bench.cpp
+//
+// Benchmark runner behind `make bench`. Renders a fixed set of scenes with a fixed
+// seed, one child process per scene, and collects wall time plus Mrays/s, peak RSS and
+// stage timings from the renderer's --stats-json output, keeping the fastest of --runs
+// runs. Results are compared against a baseline recorded on the same machine, the first
+// run (no baseline file yet) records it. The exit code is 1 when a scene traced a
+// different number of rays or paths of a different length than the baseline, which at a
+// fixed seed means the renderer's output changed, or got slower than the allowed
+// regression, so it can gate CI. Timings are only comparable on the machine that
+// recorded them, so the baseline isn't committed.
+//
+// The canonical scenes come from the repo, the generated ones (many spheres, many
+// triangles, deep reflection) are written to bench_scenes/ from a fixed RNG seed so
+// every run renders the same thing.
+//
+// Needs POSIX (fork/exec/waitpid).
+
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+struct BenchScene {
+    std::string name;
+    std::string path;
+    std::vector<std::string> args;  // extra renderer flags
+};
+
+struct BenchResult {
+    std::string name;
+    double wallSeconds;
+    long peakRssKB;
+    json stats;  // what the renderer wrote with --stats-json
+};
+
+static json vec3(float x, float y, float z) {
+    return json::array({x, y, z});
+}
+
+static json material(const json& diffuse, bool reflective, float reflectivity) {
+    return {
+        {"ks", 0.1}, {"kd", 0.9}, {"specularexponent", 20},
+        {"diffusecolor", diffuse}, {"specularcolor", vec3(1, 1, 1)},
+        {"isreflective", reflective}, {"reflectivity", reflectivity},
+        {"isrefractive", false}, {"refractiveindex", 1.0}
+    };
+}
+
+static json baseScene(int width, int height, int nbounces) {
+    json scene;
+    scene["nbounces"] = nbounces;
+    scene["rendermode"] = "phong";
+    scene["camera"] = {
+        {"type", "pinhole"}, {"width", width}, {"height", height},
+        {"position", vec3(0.0f, 1.0f, -2.0f)}, {"lookAt", vec3(0.0f, 0.0f, 1.5f)},
+        {"upVector", vec3(0, 1, 0)}, {"fov", 45.0}, {"exposure", 0.1}
+    };
+    scene["scene"] = {
+        {"backgroundcolor", vec3(0.25f, 0.25f, 0.25f)},
+        {"lightsources", json::array({{{"type", "pointlight"}, {"position", vec3(0.0f, 2.0f, 0.5f)},
+                                       {"intensity", vec3(0.75f, 0.75f, 0.75f)}}})},
+        {"shapes", json::array()}
+    };
+    return scene;
+}
+
+static json manySpheresScene(std::mt19937& rng) {
+    std::uniform_real_distribution<float> x(-1.5f, 1.5f), y(-0.5f, 1.0f), z(1.0f, 4.0f), c(0.2f, 1.0f);
+    json scene = baseScene(400, 300, 4);
+    json& shapes = scene["scene"]["shapes"];
+    for (int i = 0; i < 2000; ++i) {
+        shapes.push_back({{"type", "sphere"}, {"center", vec3(x(rng), y(rng), z(rng))}, {"radius", 0.04},
+                          {"material", material(vec3(c(rng), c(rng), c(rng)), i % 8 == 0, 0.5f)}});
+    }
+    return scene;
+}
+
+// A bumpy height field, two triangles per grid cell
+static json manyTrianglesScene(std::mt19937& rng) {
+    const int cells = 100;
+    std::uniform_real_distribution<float> bump(-0.05f, 0.05f);
+    std::vector<float> height((cells + 1) * (cells + 1));
+    for (float& h : height) {
+        h = bump(rng);
+    }
+    auto vertex = [&](int i, int j) {
+        return vec3(-2.0f + 4.0f * i / cells, -0.5f + height[j * (cells + 1) + i], 0.5f + 4.0f * j / cells);
+    };
+
+    json scene = baseScene(400, 300, 2);
+    json& shapes = scene["scene"]["shapes"];
+    json mat = material(vec3(0.6f, 0.7f, 0.5f), false, 0.0f);
+    for (int j = 0; j < cells; ++j) {
+        for (int i = 0; i < cells; ++i) {
+            shapes.push_back({{"type", "triangle"}, {"v0", vertex(i, j)}, {"v1", vertex(i + 1, j)},
+                              {"v2", vertex(i + 1, j + 1)}, {"material", mat}});
+            shapes.push_back({{"type", "triangle"}, {"v0", vertex(i, j)}, {"v1", vertex(i + 1, j + 1)},
+                              {"v2", vertex(i, j + 1)}, {"material", mat}});
+        }
+    }
+    return scene;
+}
+
+// Two facing mirrors with a few spheres between them, so most paths use every bounce
+static json deepReflectionScene(std::mt19937& rng) {
+    std::uniform_real_distribution<float> c(0.2f, 1.0f);
+    json scene = baseScene(320, 240, 16);
+    json& shapes = scene["scene"]["shapes"];
+    json mirror = material(vec3(0.9f, 0.9f, 0.9f), true, 0.9f);
+    for (float x : {-1.0f, 1.0f}) {
+        shapes.push_back({{"type", "triangle"}, {"v0", vec3(x, -1, -3)}, {"v1", vec3(x, 3, -3)},
+                          {"v2", vec3(x, 3, 6)}, {"material", mirror}});
+        shapes.push_back({{"type", "triangle"}, {"v0", vec3(x, -1, -3)}, {"v1", vec3(x, 3, 6)},
+                          {"v2", vec3(x, -1, 6)}, {"material", mirror}});
+    }
+    for (int i = 0; i < 5; ++i) {
+        shapes.push_back({{"type", "sphere"}, {"center", vec3(-0.6f + 0.3f * i, 0.0f, 1.0f + 0.4f * i)},
+                          {"radius", 0.15}, {"material", material(vec3(c(rng), c(rng), c(rng)), true, 0.3f)}});
+    }
+    return scene;
+}
+
+static std::string absolutePath(const std::string& path) {
+    char resolved[PATH_MAX];
+    if (realpath(path.c_str(), resolved) == nullptr) {
+        throw std::runtime_error("Bench scene not found: " + path);
+    }
+    return resolved;
+}
+
+static void writeJSONFile(const std::string& filename, const json& j) {
+    std::ofstream file(filename);
+    if (!file) {
+        throw std::runtime_error("Cannot write " + filename);
+    }
+    file << j.dump(2) << "\n";
+}
+
+static std::vector<BenchScene> prepareScenes(const std::string& sceneDir, unsigned seed) {
+    std::vector<BenchScene> scenes = {
+        {"scene", "scene.json", {}},
+        {"scene_phong", "scene_phong.json", {}},
+        {"mirror_image", "mirror_image.json", {}},
+        {"simple_phong_texture", "codewithtextures/simple_phong_texture.json", {}}
+    };
+
+    mkdir(sceneDir.c_str(), 0755);
+    std::mt19937 rng(seed);
+    std::vector<std::pair<std::string, json>> generated;
+    generated.emplace_back("many_spheres", manySpheresScene(rng));
+    generated.emplace_back("many_triangles", manyTrianglesScene(rng));
+    generated.emplace_back("deep_reflection", deepReflectionScene(rng));
+    for (const auto& entry : generated) {
+        std::string path = sceneDir + "/" + entry.first + ".json";
+        writeJSONFile(path, entry.second);
+        scenes.push_back({entry.first, path, {}});
+    }
+
+    // Secondary ray sorting only applies to the wavefront integrator, run the mirror
+    // heavy scenes through it with and without. Nothing in them is random, so where the
+    // recursive integrator traces ten identical paths per pixel the wavefront one traces
+    // one: compare their render times and the paths column, Mrays/s counts both.
+    for (size_t i = 0, n = scenes.size(); i < n; ++i) {
+        if (scenes[i].name == "mirror_image" || scenes[i].name == "deep_reflection") {
+            scenes.push_back({scenes[i].name + "_wavefront", scenes[i].path,
+                              {"--integrator", "wavefront", "--ray-sort", "on"}});
+            scenes.push_back({scenes[i].name + "_wavefront_unsorted", scenes[i].path,
+                              {"--integrator", "wavefront", "--ray-sort", "off"}});
+        }
+    }
+    // Path termination, compare its path length and time with plain deep_reflection
+    scenes.push_back({"deep_reflection_roulette", sceneDir + "/deep_reflection.json", {"--roulette", "2"}});
+    // Roulette makes paths random, here both integrators trace ten per pixel
+    scenes.push_back({"deep_reflection_roulette_wavefront", sceneDir + "/deep_reflection.json",
+                      {"--roulette", "2", "--integrator", "wavefront"}});
+
+    for (auto& scene : scenes) {
+        scene.path = absolutePath(scene.path);
+    }
+    return scenes;
+}
+
+// Run the renderer on one scene inside workDir (it writes output.ppm to its cwd)
+static BenchResult runScene(const std::string& renderer, const BenchScene& scene,
+                            const std::string& workDir, unsigned seed) {
+    std::string statsFile = workDir + "/" + scene.name + ".stats.json";
+    std::vector<std::string> args = {renderer, scene.path, "--seed", std::to_string(seed), "--stats-json", statsFile};
+    args.insert(args.end(), scene.args.begin(), scene.args.end());
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw std::runtime_error("fork failed");
+    }
+    if (pid == 0) {
+        if (chdir(workDir.c_str()) != 0 || freopen("/dev/null", "w", stdout) == nullptr) {
+            _exit(127);
+        }
+        execv(renderer.c_str(), argv.data());
+        _exit(127);
+    }
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0) {
+        throw std::runtime_error("waitpid failed");
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        throw std::runtime_error("Renderer failed on " + scene.name);
+    }
+
+    std::ifstream file(statsFile);
+    if (!file) {
+        throw std::runtime_error("Renderer wrote no stats for " + scene.name);
+    }
+    BenchResult result;
+    result.name = scene.name;
+    result.wallSeconds = elapsed.count();
+    result.stats = json::parse(file);
+    // Reported by the renderer itself, wait4's ru_maxrss would include the pages this
+    // process had when it forked
+    result.peakRssKB = result.stats.value("peak_rss_kb", 0L);
+    return result;
+}
+
+static json toJSON(const BenchResult& result) {
+    return {
+        {"wall_seconds", result.wallSeconds},
+        {"peak_rss_kb", result.peakRssKB},
+        {"mrays_per_second", result.stats["mrays_per_second"]},
+        {"total_rays", result.stats["counters"]["total_rays"]},
+        {"primary_rays", result.stats["counters"]["primary_rays"]},
+        {"average_path_length", result.stats.value("average_path_length", 0.0)},
+        {"stage_seconds", result.stats["stage_seconds"]}
+    };
+}
+
+static void printResults(const std::vector<BenchResult>& results) {
+    std::cout << std::left << std::setw(36) << "scene" << std::right << std::setw(10) << "Mrays/s"
+              << std::setw(10) << "Mpaths" << std::setw(10) << "wall s" << std::setw(12) << "peak RSS MB"
+              << std::setw(10) << "path len" << std::setw(10) << "parse ms" << std::setw(10) << "build ms"
+              << std::setw(11) << "render ms" << std::setw(10) << "write ms" << "\n";
+    std::cout << std::fixed;
+    for (const auto& result : results) {
+        const json& stages = result.stats["stage_seconds"];
+        auto stageMs = [&](const char* stage) { return stages.value(stage, 0.0) * 1000.0; };
+        std::cout << std::left << std::setw(36) << result.name << std::right
+                  << std::setprecision(3) << std::setw(10) << result.stats["mrays_per_second"].get<double>()
+                  << std::setw(10) << result.stats["counters"]["primary_rays"].get<double>() / 1e6
+                  << std::setw(10) << result.wallSeconds
+                  << std::setprecision(1) << std::setw(12) << result.peakRssKB / 1024.0
+                  << std::setprecision(2) << std::setw(10) << result.stats.value("average_path_length", 0.0)
+                  << std::setprecision(1)
+                  << std::setw(10) << stageMs("parse") << std::setw(10) << stageMs("build")
+                  << std::setw(11) << stageMs("render") << std::setw(10) << stageMs("write") << "\n";
+    }
+}
+
+// Returns the number of regressions. Ray count and path length are deterministic at a
+// fixed seed, any change in them is one. Timings are noisy, a scene regresses when its
+// Mrays/s drops or its wall time grows by more than maxRegression percent.
+static int compareWithBaseline(const json& current, const json& baseline, double maxRegression) {
+    int regressions = 0;
+    std::cout << std::fixed << std::setprecision(1);
+    for (auto it = current.begin(); it != current.end(); ++it) {
+        if (!baseline.contains(it.key())) {
+            std::cout << it.key() << ": not in baseline\n";
+            continue;
+        }
+        const json& base = baseline[it.key()];
+        long long rays = it.value()["total_rays"].get<long long>();
+        long long baseRays = base["total_rays"].get<long long>();
+        double pathLength = it.value()["average_path_length"].get<double>();
+        double basePathLength = base["average_path_length"].get<double>();
+        bool changed = rays != baseRays || std::fabs(pathLength - basePathLength) > 1e-9 * basePathLength;
+
+        double mraysChange = 100.0 * (it.value()["mrays_per_second"].get<double>() /
+                                      base["mrays_per_second"].get<double>() - 1.0);
+        double wallChange = 100.0 * (it.value()["wall_seconds"].get<double>() /
+                                     base["wall_seconds"].get<double>() - 1.0);
+        bool slower = mraysChange < -maxRegression || wallChange > maxRegression;
+        std::cout << it.key() << ": Mrays/s " << std::showpos << mraysChange << "%, wall "
+                  << wallChange << "%" << std::noshowpos << (slower ? "  REGRESSION" : "");
+        if (changed) {
+            std::cout << "  OUTPUT CHANGED (rays " << baseRays << " -> " << rays << ", path length "
+                      << std::setprecision(4) << basePathLength << " -> " << pathLength << ")"
+                      << std::setprecision(1);
+        }
+        std::cout << "\n";
+        if (slower || changed) {
+            ++regressions;
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char* argv[]) {
+    std::string renderer = "./ray_tracer";
+    std::string baselineFile = "bench_baseline.json";
+    std::string resultsFile = "bench_results.json";
+    std::string sceneDir = "bench_scenes";
+    double maxRegression = 10.0;
+    int runs = 3;
+    unsigned seed = 1;
+    bool updateBaseline = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--renderer" && hasValue) {
+            renderer = argv[++i];
+        } else if (arg == "--baseline" && hasValue) {
+            baselineFile = argv[++i];
+        } else if (arg == "--results" && hasValue) {
+            resultsFile = argv[++i];
+        } else if (arg == "--max-regression" && hasValue) {
+            maxRegression = std::stod(argv[++i]);
+        } else if (arg == "--runs" && hasValue) {
+            runs = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--seed" && hasValue) {
+            seed = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--update-baseline") {
+            updateBaseline = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--renderer <path>] [--baseline <file>] [--results <file>]"
+                      << " [--max-regression <percent>] [--runs <n>] [--seed <n>] [--update-baseline]\n";
+            return 2;
+        }
+    }
+
+    try {
+        renderer = absolutePath(renderer);
+        std::vector<BenchScene> scenes = prepareScenes(sceneDir, seed);
+        std::string workDir = absolutePath(sceneDir);
+
+        // Keep the fastest of several runs, it is the least disturbed by other load
+        std::vector<BenchResult> results;
+        json current = json::object();
+        for (const auto& scene : scenes) {
+            BenchResult best = runScene(renderer, scene, workDir, seed);
+            for (int run = 1; run < runs; ++run) {
+                BenchResult result = runScene(renderer, scene, workDir, seed);
+                if (result.wallSeconds < best.wallSeconds) {
+                    best = result;
+                }
+            }
+            results.push_back(best);
+            current[scene.name] = toJSON(best);
+        }
+
+        printResults(results);
+        writeJSONFile(resultsFile, current);
+
+        std::ifstream file(baselineFile);
+        if (updateBaseline || !file) {
+            writeJSONFile(baselineFile, current);
+            std::cout << (updateBaseline ? "Baseline updated: " : "No baseline yet, recorded ") << baselineFile << "\n";
+            return 0;
+        }
+        int regressions = compareWithBaseline(current, json::parse(file), maxRegression);
+        if (regressions > 0) {
+            std::cerr << regressions << " scene(s) changed output or got more than " << maxRegression
+                      << "% slower\n";
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,120 @@
+// cost_heatmap.h
+#ifndef COST_HEATMAP_H
+#define COST_HEATMAP_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Vec3.h"
+#include "image_writer.h"
+#include "render_stats.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+// What one pixel cost to render
+struct PixelCost {
+    uint64_t rays = 0;
+    uint64_t primitiveTests = 0;
+    uint64_t nodesVisited = 0;
+    uint64_t cycles = 0;
+};
+
+// Per pixel cost buffer (an AOV next to the colour image). Wrap the work for a pixel in
+// begin()/end() and it records the difference of the calling thread's render counters
+// plus the elapsed cycle count.
+class CostHeatmap {
+public:
+    struct Sample {
+        RenderCounters counters;
+        uint64_t cycles = 0;
+    };
+
+    CostHeatmap(int width, int height) : width(width), height(height), costs(width * height) {}
+
+    static Sample begin() {
+        return Sample{RenderStats::local(), readCycles()};
+    }
+
+    void end(int x, int y, const Sample& start) {
+        uint64_t cycles = readCycles();
+        const RenderCounters& now = RenderStats::local();
+        PixelCost& cost = costs[y * width + x];
+        cost.rays = now.totalRays() - start.counters.totalRays();
+        cost.primitiveTests = now.primitiveTests - start.counters.primitiveTests;
+        cost.nodesVisited = now.boxTests - start.counters.boxTests;
+        cost.cycles = cycles - start.cycles;
+    }
+
+    const PixelCost& at(int x, int y) const {
+        return costs[y * width + x];
+    }
+
+    // Writes <prefix>_rays.ppm, _prims.ppm, _nodes.ppm and _cycles.ppm in the same pixel
+    // layout as the colour image
+    void write(const std::string& prefix) const {
+        writeChannel(prefix + "_rays.ppm", &PixelCost::rays);
+        writeChannel(prefix + "_prims.ppm", &PixelCost::primitiveTests);
+        writeChannel(prefix + "_nodes.ppm", &PixelCost::nodesVisited);
+        writeChannel(prefix + "_cycles.ppm", &PixelCost::cycles);
+    }
+
+    // rdtsc where available, nanoseconds elsewhere
+    static uint64_t readCycles() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Blue -> cyan -> green -> yellow -> red for t in [0, 1]
+    static Vec3 falseColour(float t) {
+        static const Vec3 ramp[] = {
+            Vec3(0.0f, 0.0f, 0.5f), Vec3(0.0f, 0.3f, 1.0f), Vec3(0.0f, 0.9f, 0.9f),
+            Vec3(0.1f, 0.9f, 0.1f), Vec3(1.0f, 0.9f, 0.0f), Vec3(0.9f, 0.0f, 0.0f)
+        };
+        const int last = sizeof(ramp) / sizeof(ramp[0]) - 1;
+        t = std::max(0.0f, std::min(1.0f, t)) * last;
+        int i = std::min(static_cast<int>(t), last - 1);
+        float f = t - i;
+        return ramp[i] * (1.0f - f) + ramp[i + 1] * f;
+    }
+
+private:
+    int width;
+    int height;
+    std::vector<PixelCost> costs;
+
+    void writeChannel(const std::string& filename, uint64_t PixelCost::*channel) const {
+        if (costs.empty()) {
+            return;
+        }
+
+        // Scale to the 99th percentile so a few pathological pixels don't flatten the rest
+        std::vector<uint64_t> values(costs.size());
+        for (size_t i = 0; i < costs.size(); ++i) {
+            values[i] = costs[i].*channel;
+        }
+        std::vector<uint64_t> sorted = values;
+        size_t p99 = sorted.size() * 99 / 100;
+        std::nth_element(sorted.begin(), sorted.begin() + p99, sorted.end());
+        uint64_t scale = std::max<uint64_t>(sorted[p99], 1);
+
+        std::vector<Vec3> image(costs.size());
+        for (size_t i = 0; i < costs.size(); ++i) {
+            image[i] = falseColour(static_cast<float>(values[i]) / scale);
+        }
+        ImageWriter::writePPM(filename.c_str(), width, height, image.data());
+        std::cout << "  (red = " << scale << " or more per pixel)" << std::endl;
+    }
+};
+
+#endif // COST_HEATMAP_H
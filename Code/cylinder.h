@@ -5,17 +5,22 @@
 #include "Vec3.h"
 #include <nlohmann/json.hpp>
 #include "material.h"
+#include "AABB.h"
 
 class Cylinder {
 public:
     Vec3 center;
-    Vec3 axis;  // Unit vector indicating the direction along which the cylinder extends
+    Vec3 axis;  // Direction the cylinder extends in, not normalised when read from a scene file
     float radius;
     float height;
 
     Cylinder(const Vec3& center, const Vec3& axis, float radius, float height)
         : center(center), axis(axis.normalized()), radius(radius), height(height) {}
 
+    // Takes the base center and full height exactly as stored (used by the binary scene loader)
+    Cylinder(const Vec3& center, const Vec3& axis, float radius, float height, const Material& material)
+        : center(center), axis(axis), radius(radius), height(height), material(material) {}
+
     Cylinder(const nlohmann::json& json, const Material& material) : Cylinder(json) {
         this->material = material;
     }
@@ -54,7 +59,12 @@ public:
     center = center - axis * height / 2;
 
 }
-Vec3 normalAt(const Vec3& point) const {
+Vec3 normalAt(const Vec3& point, float time = 0.0f) const {
+    Vec3 center = this->center, axis = this->axis;
+    if (moving) {
+        float radius, height;
+        shapeAt(time, center, axis, radius, height);
+    }
     // Calculate the normal vector for a point on the surface of the cylinder
     Vec3 hitPointOnAxis = center + (Vec3::dot(point - center, axis) / Vec3::dot(axis, axis)) * axis;
     Vec3 normal = (point - hitPointOnAxis).normalized();
@@ -65,6 +75,9 @@ Vec3 normalAt(const Vec3& point) const {
 Material getMaterial() const {
     return material;
 }
+void setMaterial(const Material& material) {
+    this->material = material;
+}
 
 
 // set the center
@@ -72,10 +85,116 @@ void setCenter(const Vec3& center) {
     this->center = center;
 }
 
+// Box enclosing the cylinder, used by the BVH
+AABB getBoundingBox() const {
+    return boxOf(center, axis, radius, height);
+}
+
+// From the base to the top cap. intersect() takes [0, height] along the axis, which for
+// an axis that isn't unit (the scene file doesn't normalise it) is height / |axis| long.
+Vec3 span() const {
+    return spanOf(axis, height);
+}
+
+// Axis and height for the given span, the axis keeps its length so the cylinder reads
+// its radius and height the way it did. A zero span leaves a cylinder of height 0.
+void setSpan(const Vec3& span) {
+    shapeOfSpan(span, axis, height);
+}
+
+// Motion blur: where the cylinder is when the shutter closes. A ray at time t sees the
+// center and radius moved in a straight line from their values at 0 to those at 1. When
+// the axis or height change as well, the span moves in a straight line, and the axis
+// keeps its length in between.
+void setShutterClose(const Cylinder& closed) {
+    centerEnd = closed.center;
+    axisEnd = closed.axis;
+    radiusEnd = closed.radius;
+    heightEnd = closed.height;
+    reshaped = axisEnd != axis || heightEnd != height;
+    moving = reshaped || centerEnd != center || radiusEnd != radius;
+}
+
+bool isMoving() const {
+    return moving;
+}
+
+// Box at shutter close, the same as getBoundingBox() for a cylinder that doesn't move
+AABB getBoundingBoxEnd() const {
+    return moving ? boxOf(centerEnd, axisEnd, radiusEnd, heightEnd) : getBoundingBox();
+}
+
 
 
 
     bool intersect(const Ray& ray, float& t) const {
+        if (!moving) {
+            return intersectShape(ray, center, axis, radius, height, t);
+        }
+        Vec3 c, a;
+        float r, h;
+        shapeAt(ray.time, c, a, r, h);
+        return intersectShape(ray, c, a, r, h, t);
+    }
+
+    private:
+        Material material;
+        Vec3 centerEnd, axisEnd;
+        float radiusEnd = 0.0f, heightEnd = 0.0f;
+        bool reshaped = false;
+        bool moving = false;
+
+        // The cylinder at time, see setShutterClose()
+        void shapeAt(float time, Vec3& c, Vec3& a, float& r, float& h) const {
+            c = center + (centerEnd - center) * time;
+            r = radius + (radiusEnd - radius) * time;
+            a = axis;
+            h = height;
+            if (reshaped) {
+                Vec3 start = spanOf(axis, height);
+                shapeOfSpan(start + (spanOf(axisEnd, heightEnd) - start) * time, a, h);
+            }
+        }
+
+        static Vec3 spanOf(const Vec3& axis, float height) {
+            float axisLengthSquared = Vec3::dot(axis, axis);
+            return axisLengthSquared > 0.0f ? axis * (height / axisLengthSquared) : Vec3(0.0f, 0.0f, 0.0f);
+        }
+
+        // Points axis along span at its current length and sets height to match
+        static void shapeOfSpan(const Vec3& span, Vec3& axis, float& height) {
+            float axisLength = axis.length();
+            float spanLength = span.length();
+            if (axisLength <= 0.0f || spanLength <= 0.0f) {
+                height = 0.0f;
+                return;
+            }
+            axis = span * (axisLength / spanLength);
+            height = spanLength * axisLength;
+        }
+
+// Box enclosing a cylinder. intersect() accepts hits whose projection on the axis lies
+// in [0, height], so the end caps sit at center and center + axis * height / |axis|^2
+// (the same point for a unit axis).
+static AABB boxOf(const Vec3& center, const Vec3& axis, float radius, float height) {
+    float axisLengthSquared = Vec3::dot(axis, axis);
+    if (axisLengthSquared <= 0.0f) {
+        return AABB(center, center);
+    }
+    Vec3 top = center + axis * (height / axisLengthSquared);
+
+    // For a non-unit axis the accepted distance from the axis grows along it
+    float along = height / std::sqrt(axisLengthSquared);
+    float spread = std::max(0.0f, along * along * (axisLengthSquared - 1.0f));
+    float extent = std::sqrt(radius * radius + spread);
+
+    Vec3 low(std::min(center.x, top.x), std::min(center.y, top.y), std::min(center.z, top.z));
+    Vec3 high(std::max(center.x, top.x), std::max(center.y, top.y), std::max(center.z, top.z));
+    return AABB(low - Vec3(extent, extent, extent), high + Vec3(extent, extent, extent));
+}
+
+    static bool intersectShape(const Ray& ray, const Vec3& center, const Vec3& axis, float radius, float height,
+                               float& t) {
         Vec3 oc = ray.origin - center;
 
         Vec3 directionPerpendicular = ray.direction - Vec3::dot(ray.direction, axis) * axis;
@@ -112,9 +231,6 @@ void setCenter(const Vec3& center) {
 
         return false;
     }
-
-    private:
-        Material material;
 };
 
 #endif // CYLINDER_H
@@ -0,0 +1,562 @@
+// distributed.h
+//
+// One frame rendered across several machines. Worker processes (--worker [host:]port)
+// listen on TCP, the coordinator (--workers host:port,host:port,...) sends them the scene
+// and then jobs of consecutive tiles, and puts the tiles that come back into its image.
+// Every tile draws its random numbers from its own seed (see TileGrid::seed()), so the
+// frame comes out the same as rendered on one machine with the same seed, whichever
+// worker rendered which tile.
+//
+// Messages go both ways as a JSON line, followed by "bytes" bytes of payload if the line
+// has that field:
+//
+//   {"op": "scene", "bytes": n} + the JSON scene  ->  {"ok": true, "width": 800, "height": 600,
+//                                                      "cached": false, "loadMs": 3.1, "buildMs": 40.2}
+//   {"op": "tiles", "first": 40, "count": 12, "seed": 7,   ->  {"ok": true, "first": 40, "count": 12,
+//    "rouletteDepth": -1, "cutoff": 0}                          "bytes": 36864} + pixels
+//
+// Path termination (--roulette, --cutoff) is the coordinator's and goes along with every
+// tiles job, a worker's own settings never apply.
+// The pixels are those of the tiles in tile order, row by row within a tile, three floats
+// each as the machines store them (so workers and coordinator need the same endianness).
+// A request that fails is answered with {"ok": false, "error": "..."}.
+//
+// The coordinator cuts the frame into about jobsPerWorker jobs per worker, so faster
+// workers end up rendering more of it, and keeps jobsInFlight jobs queued at every worker,
+// so none of them waits on the network for its next job. A worker that disconnects or
+// fails a request is dropped and its unfinished jobs go back into the queue for the
+// others, the render only fails once no worker is left.
+//
+// Workers keep the last scene they were sent along with its BVH, so the next frame of the
+// same scene skips parsing and the build. Mesh files the scene refers to are read by the
+// workers, at the same paths relative to where each worker runs.
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <nlohmann/json.hpp>
+#include "Vec3.h"
+#include "arena.h"
+#include "optics.h"
+#include "scene.h"
+#include "scene_sax.h"
+#include "tiles.h"
+
+// One end of a TCP connection carrying the messages above
+class TileConnection {
+public:
+    explicit TileConnection(int fd) : fd(fd) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    ~TileConnection() {
+        close(fd);
+    }
+
+    TileConnection(const TileConnection&) = delete;
+    TileConnection& operator=(const TileConnection&) = delete;
+
+    // Connects to host:port, throws if it can't
+    static std::unique_ptr<TileConnection> connectTo(const std::string& address) {
+        std::string host, port;
+        splitAddress(address, host, port);
+        if (host.empty()) {
+            throw std::invalid_argument("Worker address needs to be host:port: " + address);
+        }
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found = nullptr;
+        int status = getaddrinfo(host.c_str(), port.c_str(), &hints, &found);
+        if (status != 0) {
+            throw std::runtime_error("Failed to look up " + address + ": " + gai_strerror(status));
+        }
+        std::string reason = "no address";
+        for (addrinfo* candidate = found; candidate != nullptr; candidate = candidate->ai_next) {
+            int fd = socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+            if (fd < 0) {
+                reason = std::strerror(errno);
+                continue;
+            }
+            if (connect(fd, candidate->ai_addr, candidate->ai_addrlen) == 0) {
+                freeaddrinfo(found);
+                return std::unique_ptr<TileConnection>(new TileConnection(fd));
+            }
+            reason = std::strerror(errno);
+            close(fd);
+        }
+        freeaddrinfo(found);
+        throw std::runtime_error("Failed to connect to " + address + ": " + reason);
+    }
+
+    // Listening socket for [host:]port, on every interface without a host
+    static int listenOn(const std::string& address) {
+        std::string host, port;
+        splitAddress(address, host, port);
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* found = nullptr;
+        int status = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found);
+        if (status != 0) {
+            throw std::runtime_error("Failed to look up " + address + ": " + gai_strerror(status));
+        }
+        std::string reason = "no address";
+        for (addrinfo* candidate = found; candidate != nullptr; candidate = candidate->ai_next) {
+            int fd = socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+            if (fd < 0) {
+                reason = std::strerror(errno);
+                continue;
+            }
+            int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            if (bind(fd, candidate->ai_addr, candidate->ai_addrlen) == 0 && listen(fd, 16) == 0) {
+                freeaddrinfo(found);
+                return fd;
+            }
+            reason = std::strerror(errno);
+            close(fd);
+        }
+        freeaddrinfo(found);
+        throw std::runtime_error("Failed to listen on " + address + ": " + reason);
+    }
+
+    int descriptor() const {
+        return fd;
+    }
+
+    // Throws if the other end is gone
+    void send(const nlohmann::json& header, const std::string& payload = std::string()) {
+        std::string bytes = header.dump() + "\n" + payload;
+        size_t sent = 0;
+        while (sent < bytes.size()) {
+            ssize_t n = ::send(fd, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                throw std::runtime_error(n < 0 ? std::strerror(errno) : "connection closed");
+            }
+            sent += static_cast<size_t>(n);
+        }
+    }
+
+    // Reads what has arrived, call when poll() says there is something. false once the
+    // other end is gone.
+    bool receive() {
+        char buffer[64 * 1024];
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received < 0 && errno == EINTR) {
+            return true;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        pending.append(buffer, static_cast<size_t>(received));
+        return true;
+    }
+
+    // Takes the next whole message off what was received, false if there isn't one yet
+    bool nextMessage(nlohmann::json& header, std::string& payload) {
+        size_t newline = pending.find('\n');
+        if (newline == std::string::npos) {
+            if (pending.size() > maxMessageBytes) {
+                throw std::runtime_error("Message header longer than " + std::to_string(maxMessageBytes) + " bytes");
+            }
+            return false;
+        }
+        header = nlohmann::json::parse(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(newline));
+        if (!header.is_object()) {
+            throw std::runtime_error("A message needs to be a JSON object");
+        }
+        size_t bytes = header.value("bytes", static_cast<size_t>(0));
+        if (bytes > maxMessageBytes) {
+            throw std::runtime_error("Message payload larger than " + std::to_string(maxMessageBytes) + " bytes");
+        }
+        if (pending.size() - newline - 1 < bytes) {
+            return false;
+        }
+        payload.assign(pending, newline + 1, bytes);
+        pending.erase(0, newline + 1 + bytes);
+        return true;
+    }
+
+private:
+    static const size_t maxMessageBytes = 1024 * 1024 * 1024;
+
+    int fd;
+    std::string pending;  // received bytes not yet forming a whole message
+
+    static void splitAddress(const std::string& address, std::string& host, std::string& port) {
+        size_t colon = address.rfind(':');
+        host = colon == std::string::npos ? std::string() : address.substr(0, colon);
+        port = colon == std::string::npos ? address : address.substr(colon + 1);
+        if (port.empty() || port.find_first_not_of("0123456789") != std::string::npos) {
+            throw std::invalid_argument("Address needs a port number: " + address);
+        }
+    }
+};
+
+class TileWorker {
+public:
+    // Renders tiles [first, first + count) of tiles, over the scene's first camera, into
+    // image (the whole frame), stopping paths as termination says
+    using RenderFunction = std::function<void(const Scene& scene, const TileGrid& tiles, size_t first, size_t count,
+                                              unsigned seed, const PathTermination& termination, Vec3* image)>;
+
+    TileWorker(const std::string& address, RenderFunction render)
+        : listener(TileConnection::listenOn(address)), render(std::move(render)) {}
+
+    ~TileWorker() {
+        close(listener);
+    }
+
+    TileWorker(const TileWorker&) = delete;
+    TileWorker& operator=(const TileWorker&) = delete;
+
+    // Serves one coordinator after the other until stop is set (from a signal handler)
+    void run(const volatile std::sig_atomic_t& stop) {
+        while (!stop) {
+            if (!readable(listener)) {
+                continue;
+            }
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd < 0) {
+                continue;
+            }
+            TileConnection connection(fd);
+            ++coordinators;
+            std::cout << "Coordinator " << coordinators << " connected" << std::endl;
+            serve(connection, stop);
+        }
+        std::cout << "Tile worker: " << jobs << " jobs, " << tilesRendered << " tiles for " << coordinators
+                  << " coordinators" << std::endl;
+    }
+
+private:
+    int listener;
+    RenderFunction render;
+    std::string sceneText;  // of scene, empty while there is none
+    Scene scene;
+    std::vector<Vec3> image;
+    size_t coordinators = 0;
+    size_t jobs = 0;
+    size_t tilesRendered = 0;
+
+    // Waits a moment for fd to become readable, so the loops notice stop
+    static bool readable(int fd) {
+        pollfd polled{fd, POLLIN, 0};
+        return poll(&polled, 1, 200) > 0;
+    }
+
+    static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void serve(TileConnection& connection, const volatile std::sig_atomic_t& stop) {
+        nlohmann::json header;
+        std::string payload, replyPayload;
+        try {
+            while (!stop) {
+                if (!readable(connection.descriptor())) {
+                    continue;
+                }
+                if (!connection.receive()) {
+                    return;
+                }
+                while (connection.nextMessage(header, payload)) {
+                    replyPayload.clear();
+                    nlohmann::json reply = handle(header, payload, replyPayload);
+                    connection.send(reply, replyPayload);
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error: lost the coordinator: " << e.what() << "\n";
+        }
+    }
+
+    // The answer to one request, its payload goes to replyPayload
+    nlohmann::json handle(const nlohmann::json& request, const std::string& payload, std::string& replyPayload) {
+        try {
+            std::string op = request.value("op", std::string());
+            if (op == "scene") {
+                return loadScene(payload);
+            }
+            if (op == "tiles") {
+                return renderTiles(request, replyPayload);
+            }
+            throw std::invalid_argument("Unknown op: " + op);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: tile job failed: " << e.what() << "\n";
+            replyPayload.clear();
+            return nlohmann::json{{"ok", false}, {"error", e.what()}};
+        }
+    }
+
+    nlohmann::json loadScene(const std::string& text) {
+        bool cached = !sceneText.empty() && text == sceneText;
+        double loadMs = 0.0, buildMs = 0.0;
+        if (!cached) {
+            sceneText.clear();
+            auto start = std::chrono::steady_clock::now();
+            scene = JsonSceneLoader::parse(text.data(), text.data() + text.size());
+            if (scene.cameras.empty()) {
+                throw std::invalid_argument("Scene has no camera");
+            }
+            loadMs = millisecondsSince(start);
+            start = std::chrono::steady_clock::now();
+            Arena scratch;
+            scene.buildBVH(scratch);
+            buildMs = millisecondsSince(start);
+            image.assign(static_cast<size_t>(scene.cameras[0].width) * scene.cameras[0].height, Vec3(0.0f, 0.0f, 0.0f));
+            sceneText = text;
+        }
+        std::cout << "Scene " << (cached ? "kept" : "loaded") << ", " << scene.cameras[0].width << "x"
+                  << scene.cameras[0].height << std::endl;
+        return nlohmann::json{{"ok", true}, {"width", scene.cameras[0].width}, {"height", scene.cameras[0].height},
+                              {"cached", cached}, {"loadMs", loadMs}, {"buildMs", buildMs}};
+    }
+
+    nlohmann::json renderTiles(const nlohmann::json& request, std::string& payload) {
+        if (sceneText.empty()) {
+            throw std::invalid_argument("No scene to render tiles of");
+        }
+        const PinholeCamera& camera = scene.cameras[0];
+        TileGrid tiles(camera.width, camera.height);
+        size_t first = request.at("first").get<size_t>();
+        size_t count = request.at("count").get<size_t>();
+        if (count == 0 || first >= tiles.count() || count > tiles.count() - first) {
+            throw std::out_of_range("No tiles " + std::to_string(first) + " to " + std::to_string(first + count - 1) +
+                                    ", the frame has " + std::to_string(tiles.count()));
+        }
+        PathTermination termination;
+        termination.rouletteDepth = request.value("rouletteDepth", termination.rouletteDepth);
+        termination.cutoff = request.value("cutoff", termination.cutoff);
+        render(scene, tiles, first, count, request.value("seed", 0u), termination, image.data());
+
+        payload.clear();
+        for (size_t tile = first; tile < first + count; ++tile) {
+            TileRect rect = tiles.rect(tile);
+            for (int y = rect.y0; y < rect.y1; ++y) {
+                for (int x = rect.x0; x < rect.x1; ++x) {
+                    const Vec3& pixel = image[static_cast<size_t>(y) * camera.width + x];
+                    float rgb[3] = {pixel.x, pixel.y, pixel.z};
+                    payload.append(reinterpret_cast<const char*>(rgb), sizeof(rgb));
+                }
+            }
+        }
+        ++jobs;
+        tilesRendered += count;
+        return nlohmann::json{{"ok", true}, {"first", first}, {"count", count}, {"bytes", payload.size()}};
+    }
+};
+
+class TileCoordinator {
+public:
+    // Connects to the workers, ones that can't be reached are left out with a warning
+    explicit TileCoordinator(const std::vector<std::string>& addresses) {
+        for (const std::string& address : addresses) {
+            Worker worker;
+            worker.address = address;
+            try {
+                worker.connection = TileConnection::connectTo(address);
+                workers.push_back(std::move(worker));
+            } catch (const std::exception& e) {
+                std::cerr << "Warning: " << e.what() << ", rendering without it\n";
+            }
+        }
+        if (workers.empty()) {
+            throw std::runtime_error("None of the " + std::to_string(addresses.size()) + " workers can be reached");
+        }
+    }
+
+    // Renders the first camera of sceneText, a JSON scene, into image (width * height,
+    // the camera's size). Throws once no worker is left or stop is set.
+    void render(const std::string& sceneText, int width, int height, unsigned seed,
+                const PathTermination& termination, Vec3* image,
+                const volatile std::sig_atomic_t& stop) {
+        TileGrid tiles(width, height);
+        size_t perJob = std::max<size_t>(1, tiles.count() / (workers.size() * jobsPerWorker));
+        std::vector<Job> jobs;
+        for (size_t first = 0; first < tiles.count(); first += perJob) {
+            jobs.push_back(Job{first, std::min(perJob, tiles.count() - first)});
+        }
+        std::deque<size_t> queue;
+        for (size_t job = 0; job < jobs.size(); ++job) {
+            queue.push_back(job);
+        }
+
+        // Tile jobs go out right behind the scene, a worker answers in order
+        for (Worker& worker : workers) {
+            try {
+                worker.connection->send(nlohmann::json{{"op", "scene"}, {"bytes", sceneText.size()}}, sceneText);
+                worker.sceneLoaded = false;
+            } catch (const std::exception& e) {
+                lose(worker, e.what(), queue);
+            }
+        }
+
+        size_t jobsDone = 0;
+        std::vector<pollfd> polled;
+        std::vector<Worker*> polledWorkers;
+        nlohmann::json header;
+        std::string payload;
+        while (jobsDone < jobs.size()) {
+            if (stop) {
+                throw std::runtime_error("Distributed render interrupted");
+            }
+            polled.clear();
+            polledWorkers.clear();
+            for (Worker& worker : workers) {
+                while (worker.connection && worker.inFlight.size() < jobsInFlight && !queue.empty()) {
+                    size_t job = queue.front();
+                    queue.pop_front();
+                    worker.inFlight.push_back(job);
+                    try {
+                        worker.connection->send(nlohmann::json{{"op", "tiles"}, {"first", jobs[job].first},
+                                                               {"count", jobs[job].count}, {"seed", seed},
+                                                               {"rouletteDepth", termination.rouletteDepth},
+                                                               {"cutoff", termination.cutoff}});
+                    } catch (const std::exception& e) {
+                        lose(worker, e.what(), queue);
+                    }
+                }
+                if (worker.connection) {
+                    polled.push_back(pollfd{worker.connection->descriptor(), POLLIN, 0});
+                    polledWorkers.push_back(&worker);
+                }
+            }
+            if (polled.empty()) {
+                throw std::runtime_error("No workers left, " + std::to_string(jobs.size() - jobsDone) + " of " +
+                                         std::to_string(jobs.size()) + " tile jobs not rendered");
+            }
+
+            // Wakes up now and then to notice stop
+            if (poll(polled.data(), polled.size(), 200) < 0 && errno != EINTR) {
+                throw std::runtime_error("Failed to poll workers: " + std::string(std::strerror(errno)));
+            }
+            for (size_t i = 0; i < polled.size(); ++i) {
+                Worker& worker = *polledWorkers[i];
+                if (polled[i].revents == 0) {
+                    continue;
+                }
+                try {
+                    if (!worker.connection->receive()) {
+                        throw std::runtime_error("connection closed");
+                    }
+                    while (worker.connection->nextMessage(header, payload)) {
+                        if (!header.value("ok", false)) {
+                            throw std::runtime_error(header.value("error", std::string("request failed")));
+                        }
+                        if (!worker.sceneLoaded) {
+                            if (header.value("width", 0) != width || header.value("height", 0) != height) {
+                                throw std::runtime_error("worker's scene has a different image size");
+                            }
+                            worker.sceneLoaded = true;
+                            continue;
+                        }
+                        if (worker.inFlight.empty()) {
+                            throw std::runtime_error("tiles nobody asked for");
+                        }
+                        const Job& job = jobs[worker.inFlight.front()];
+                        takeTiles(tiles, job, header, payload, image);
+                        worker.inFlight.pop_front();
+                        worker.tiles += job.count;
+                        ++jobsDone;
+                    }
+                } catch (const std::exception& e) {
+                    lose(worker, e.what(), queue);
+                }
+            }
+        }
+    }
+
+    void printSummary(std::ostream& out) const {
+        out << "Distributed: " << workers.size() << " workers, " << retriedJobs << " tile jobs retried" << std::endl;
+        for (const Worker& worker : workers) {
+            out << "  " << worker.address << ": " << worker.tiles << " tiles" << (worker.connection ? "" : " (lost)")
+                << std::endl;
+        }
+    }
+
+private:
+    // Jobs per worker the frame is cut into, and how many each worker has queued at once
+    static const size_t jobsPerWorker = 16;
+    static const size_t jobsInFlight = 2;
+
+    // Tiles [first, first + count)
+    struct Job {
+        size_t first;
+        size_t count;
+    };
+
+    struct Worker {
+        std::string address;
+        std::unique_ptr<TileConnection> connection;  // null once lost
+        bool sceneLoaded = false;                      // the scene's answer has come
+        std::deque<size_t> inFlight;                   // jobs sent and not answered, in order
+        size_t tiles = 0;
+    };
+
+    std::vector<Worker> workers;
+    size_t retriedJobs = 0;
+
+    // Drops the worker and puts its unfinished jobs back at the front of the queue
+    void lose(Worker& worker, const std::string& reason, std::deque<size_t>& queue) {
+        std::cerr << "Warning: lost worker " << worker.address << " (" << reason << "), " << worker.inFlight.size()
+                  << " tile jobs go to the others\n";
+        retriedJobs += worker.inFlight.size();
+        queue.insert(queue.begin(), worker.inFlight.begin(), worker.inFlight.end());
+        worker.inFlight.clear();
+        worker.connection.reset();
+    }
+
+    static void takeTiles(const TileGrid& tiles, const Job& job, const nlohmann::json& header, const std::string& payload,
+                          Vec3* image) {
+        size_t pixels = 0;
+        for (size_t tile = job.first; tile < job.first + job.count; ++tile) {
+            TileRect rect = tiles.rect(tile);
+            pixels += static_cast<size_t>(rect.x1 - rect.x0) * (rect.y1 - rect.y0);
+        }
+        if (header.value("first", job.first + 1) != job.first || header.value("count", job.count + 1) != job.count ||
+            payload.size() != pixels * 3 * sizeof(float)) {
+            throw std::runtime_error("answer doesn't match the tiles asked for");
+        }
+
+        const char* data = payload.data();
+        for (size_t tile = job.first; tile < job.first + job.count; ++tile) {
+            TileRect rect = tiles.rect(tile);
+            for (int y = rect.y0; y < rect.y1; ++y) {
+                for (int x = rect.x0; x < rect.x1; ++x) {
+                    float rgb[3];
+                    std::memcpy(rgb, data, sizeof(rgb));
+                    data += sizeof(rgb);
+                    image[static_cast<size_t>(y) * tiles.width + x] = Vec3(rgb[0], rgb[1], rgb[2]);
+                }
+            }
+        }
+    }
+};
+
+#endif // DISTRIBUTED_H
@@ -0,0 +1,195 @@
+// frame_writer.h
+//
+// Background stage that writes finished animation frames, so the renderer doesn't wait
+// for the encode and the disk. Framebuffers come from a fixed set: acquire() hands out a
+// free one, submit() queues it for the writer thread, which writes it and puts it back.
+// Once every buffer is being rendered into or waiting in the queue, acquire() blocks
+// until the writer frees one, so slow storage holds the renderer back instead of piling
+// up frames in memory. The time spent blocked there is reported as the stall time.
+//
+// Frames are written in order, which a video stream needs. acquire() hands out the frame
+// numbers along with the buffers, so the oldest frame not yet written always has a
+// buffer: it is either queued or still rendering, and the writer can't get stuck
+// holding later frames while it waits for a frame that has no buffer to render into.
+#ifndef FRAME_WRITER_H
+#define FRAME_WRITER_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Vec3.h"
+#include "trace.h"
+
+struct FrameWriterStats {
+    size_t framesWritten = 0;
+    size_t maxQueueDepth = 0;     // frames waiting to be written, seen at submit()
+    double meanQueueDepth = 0.0;
+    size_t stalls = 0;            // acquire() calls that had to wait for a buffer
+    double stallMs = 0.0;         // total time those waited
+    double writeMs = 0.0;         // writer thread busy time
+};
+
+class FrameWriter {
+public:
+    struct Frame {
+        int index = 0;
+        std::vector<Vec3> pixels;
+    };
+
+    // Writes one frame, called on the writer thread for frame 0, 1, 2, ...
+    using WriteFunction = std::function<void(const Frame&)>;
+
+    // frames frames in buffers framebuffers of width * height. The renderer holds some
+    // and the rest are the queue, so it needs more than the frames rendered at once.
+    FrameWriter(int width, int height, int frames, size_t buffers, WriteFunction write)
+        : write(std::move(write)), frames(frames) {
+        for (size_t i = 0; i < std::max<size_t>(buffers, 1); ++i) {
+            storage.emplace_back(new Frame());
+            storage.back()->pixels.resize(static_cast<size_t>(width) * height);
+            freeFrames.push_back(storage.back().get());
+        }
+        writer = std::thread([this] { writerLoop(); });
+    }
+
+    ~FrameWriter() {
+        stop();
+    }
+
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+
+    // A free framebuffer for the next frame, its index set, waits for the writer when
+    // there is none. nullptr once every frame has been handed out. Throws the writer's
+    // error once a write failed, so rendering stops early.
+    Frame* acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (nextFrame >= frames) {
+            return nullptr;
+        }
+        if (freeFrames.empty() && !error) {
+            TRACE_SCOPE("wait for frame buffer", "io");
+            auto start = std::chrono::steady_clock::now();
+            changed.wait(lock, [this] { return !freeFrames.empty() || error; });
+            ++statistics.stalls;
+            statistics.stallMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        Frame* frame = freeFrames.back();
+        freeFrames.pop_back();
+        frame->index = nextFrame++;
+        return frame;
+    }
+
+    // Queues a frame from acquire() for writing
+    void submit(Frame* frame) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue[frame->index] = frame;
+            statistics.maxQueueDepth = std::max(statistics.maxQueueDepth, queue.size());
+            queueDepthTotal += queue.size();
+            ++submitted;
+        }
+        changed.notify_all();
+    }
+
+    // Writes what is still queued, stops the writer thread and rethrows a write error
+    void finish() {
+        stop();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    FrameWriterStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        FrameWriterStats result = statistics;
+        result.meanQueueDepth = submitted ? static_cast<double>(queueDepthTotal) / submitted : 0.0;
+        return result;
+    }
+
+private:
+    WriteFunction write;
+    std::vector<std::unique_ptr<Frame>> storage;
+    std::vector<Frame*> freeFrames;
+    std::map<int, Frame*> queue;  // by frame index, written once all before it are
+    int frames;
+    int nextFrame = 0;    // next frame acquire() hands out
+    int nextWrite = 0;    // next frame to write
+    std::thread writer;
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    bool stopping = false;
+    std::exception_ptr error;
+    FrameWriterStats statistics;
+    size_t queueDepthTotal = 0;
+    size_t submitted = 0;
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        if (writer.joinable()) {
+            writer.join();
+        }
+    }
+
+    void writerLoop() {
+        for (;;) {
+            Frame* frame;
+            bool failed;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                // Frames after a gap wait for it. A gap left at stop() is a frame whose
+                // render threw, the frames after it aren't written.
+                changed.wait(lock, [this] { return stopping || queue.count(nextWrite); });
+                auto next = queue.find(nextWrite);
+                if (next == queue.end()) {
+                    return;
+                }
+                frame = next->second;
+                queue.erase(next);
+                ++nextWrite;
+                failed = static_cast<bool>(error);
+            }
+
+            // After a failed write the rest are dropped, the error ends the render anyway
+            if (!failed) {
+                TRACE_SCOPE_ARG("write frame", "io", frame->index);
+                auto start = std::chrono::steady_clock::now();
+                std::exception_ptr caught;
+                try {
+                    write(*frame);
+                } catch (...) {
+                    caught = std::current_exception();
+                }
+                double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                std::lock_guard<std::mutex> lock(mutex);
+                statistics.writeMs += elapsed;
+                if (caught) {
+                    error = caught;
+                } else {
+                    ++statistics.framesWritten;
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                freeFrames.push_back(frame);
+            }
+            changed.notify_all();
+        }
+    }
+};
+
+#endif // FRAME_WRITER_H
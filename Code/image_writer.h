@@ -3,13 +3,19 @@
 
 #include "Vec3.h"
 #include "Color.h"  // Include the Color class for the clamp function
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <stdexcept>
+#include <string>
 
 class ImageWriter {
 public:
     static void writePPM(const char* filename, int width, int height, const Vec3* image) {
         std::ofstream file(filename);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open image for writing: " + std::string(filename));
+        }
         file << "P3\n" << width << " " << height << "\n255\n";
 
         for (int j = height - 1; j >= 0; --j) {
@@ -27,9 +33,30 @@ public:
                 file << r << " " << g << " " << b << "\n";
             }
         }
+        if (!file) {
+            throw std::runtime_error("Failed to write image: " + std::string(filename));
+        }
 
         std::cout << "Image generated: " << filename << std::endl;
     }
+
+    // The same image as binary PPM (P6) in memory, pixels quantised and ordered like writePPM
+    static std::string encodeBinaryPPM(int width, int height, const Vec3* image) {
+        std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+        std::string bytes(header.size() + static_cast<size_t>(width) * height * 3, '\0');
+        std::copy(header.begin(), header.end(), bytes.begin());
+        size_t o = header.size();
+        for (int j = height - 1; j >= 0; --j) {
+            for (int i = width - 1; i >= 0; --i) {
+                Color clampedColor(image[j * width + i].x, image[j * width + i].y, image[j * width + i].z);
+                clampedColor.clamp();
+                bytes[o++] = static_cast<char>(static_cast<int>(255.99f * clampedColor.r));
+                bytes[o++] = static_cast<char>(static_cast<int>(255.99f * clampedColor.g));
+                bytes[o++] = static_cast<char>(static_cast<int>(255.99f * clampedColor.b));
+            }
+        }
+        return bytes;
+    }
 };
 
 #endif // IMAGE_WRITER_H
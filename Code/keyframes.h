@@ -0,0 +1,160 @@
+// keyframes.h
+//
+// Keyframed animation read from the scene file. A shape or the camera can carry an
+// "animation" object of curves, each a list of [frame, x, y, z] keys in increasing
+// frame order:
+//
+//   "animation": {
+//       "translate": [[0, 0, 0, 0], [12, 0, 0.5, 0], [24, 0, 0, 0]],
+//       "rotate": [[0, 0, 0, 0], [24, 0, 360, 0]],     degrees about x, then y, then z
+//       "scale": [[0, 1, 1, 1], [24, 2, 2, 2]],
+//       "pivot": [0, 0.3, 1],                            centre of rotation and scale
+//       "interpolation": "smooth"                        or "linear" (default)
+//   }
+//
+// Shapes are moved from where the file puts them: translate, rotate and scale default
+// to nothing, and the pivot to the shape's centre (the origin for triangles and
+// meshes, a mesh moves as one). The camera's curves are "position" and "lookAt".
+// Before the first key a curve holds its first value, after the last its last value.
+// "smooth" interpolates with Catmull-Rom splines through the keys instead of lines.
+#ifndef KEYFRAMES_H
+#define KEYFRAMES_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Vec3.h"
+
+struct Keyframe {
+    float frame;
+    Vec3 value;
+};
+
+class KeyframeCurve {
+public:
+    std::vector<Keyframe> keys;
+    bool smooth = false;
+
+    // From the flattened numbers of a JSON list of [frame, x, y, z] keys
+    static KeyframeCurve fromNumbers(const std::vector<double>& numbers, const std::string& name) {
+        if (numbers.empty() || numbers.size() % 4 != 0) {
+            throw std::invalid_argument("Keyframes of '" + name + "' need to be [frame, x, y, z] lists");
+        }
+        KeyframeCurve curve;
+        for (size_t i = 0; i < numbers.size(); i += 4) {
+            Keyframe key{static_cast<float>(numbers[i]),
+                         Vec3(static_cast<float>(numbers[i + 1]), static_cast<float>(numbers[i + 2]),
+                              static_cast<float>(numbers[i + 3]))};
+            if (!curve.keys.empty() && key.frame <= curve.keys.back().frame) {
+                throw std::invalid_argument("Keyframes of '" + name + "' need increasing frames");
+            }
+            curve.keys.push_back(key);
+        }
+        return curve;
+    }
+
+    bool empty() const {
+        return keys.empty();
+    }
+
+    float lastFrame() const {
+        return keys.empty() ? 0.0f : keys.back().frame;
+    }
+
+    // Value at frame, found by binary search over the keys
+    Vec3 evaluate(float frame, const Vec3& defaultValue) const {
+        if (keys.empty()) {
+            return defaultValue;
+        }
+        if (frame <= keys.front().frame) {
+            return keys.front().value;
+        }
+        if (frame >= keys.back().frame) {
+            return keys.back().value;
+        }
+
+        auto next = std::upper_bound(keys.begin(), keys.end(), frame,
+                                     [](float f, const Keyframe& key) { return f < key.frame; });
+        size_t i = static_cast<size_t>(next - keys.begin()) - 1;
+        const Keyframe& a = keys[i];
+        const Keyframe& b = keys[i + 1];
+        float t = (frame - a.frame) / (b.frame - a.frame);
+        if (!smooth) {
+            return a.value + (b.value - a.value) * t;
+        }
+
+        // Catmull-Rom, the end keys stand in for the missing neighbours
+        const Vec3& before = i > 0 ? keys[i - 1].value : a.value;
+        const Vec3& after = i + 2 < keys.size() ? keys[i + 2].value : b.value;
+        float t2 = t * t, t3 = t2 * t;
+        return 0.5f * ((2.0f * a.value) + (b.value - before) * t +
+                       (2.0f * before - 5.0f * a.value + 4.0f * b.value - after) * t2 +
+                       (3.0f * a.value - before - 3.0f * b.value + after) * t3);
+    }
+};
+
+// Rotation, scale and translation about a pivot at one frame, as a 3x3 matrix and an
+// offset: p' = m * (p - pivot) + pivot + translation
+struct KeyframeTransform {
+    Vec3 row[3];
+    Vec3 pivot;
+    Vec3 translation;
+    float largestScale;
+
+    Vec3 applyToVector(const Vec3& v) const {
+        return Vec3(Vec3::dot(row[0], v), Vec3::dot(row[1], v), Vec3::dot(row[2], v));
+    }
+
+    Vec3 applyToPoint(const Vec3& p) const {
+        return applyToVector(p - pivot) + pivot + translation;
+    }
+};
+
+// The curves of one shape. Its primitives are [first, first + count) of the scene's
+// spheres, cylinders or triangles, depending on type (a PrimitiveType).
+struct ObjectTrack {
+    uint32_t type = 0;
+    uint32_t first = 0;
+    uint32_t count = 0;
+    Vec3 pivot = Vec3(0.0f, 0.0f, 0.0f);
+    KeyframeCurve translate, rotate, scale;
+
+    float lastFrame() const {
+        return std::max(translate.lastFrame(), std::max(rotate.lastFrame(), scale.lastFrame()));
+    }
+
+    KeyframeTransform at(float frame) const {
+        Vec3 angles = rotate.evaluate(frame, Vec3(0.0f, 0.0f, 0.0f)) * (3.14159265358979323846f / 180.0f);
+        Vec3 factors = scale.evaluate(frame, Vec3(1.0f, 1.0f, 1.0f));
+
+        // Rz * Ry * Rx, then the scale on the right
+        float cx = std::cos(angles.x), sx = std::sin(angles.x);
+        float cy = std::cos(angles.y), sy = std::sin(angles.y);
+        float cz = std::cos(angles.z), sz = std::sin(angles.z);
+        KeyframeTransform transform;
+        transform.row[0] = Vec3(cz * cy * factors.x, (cz * sy * sx - sz * cx) * factors.y, (cz * sy * cx + sz * sx) * factors.z);
+        transform.row[1] = Vec3(sz * cy * factors.x, (sz * sy * sx + cz * cx) * factors.y, (sz * sy * cx - cz * sx) * factors.z);
+        transform.row[2] = Vec3(-sy * factors.x, cy * sx * factors.y, cy * cx * factors.z);
+        transform.pivot = pivot;
+        transform.translation = translate.evaluate(frame, Vec3(0.0f, 0.0f, 0.0f));
+        transform.largestScale = std::max(std::abs(factors.x), std::max(std::abs(factors.y), std::abs(factors.z)));
+        return transform;
+    }
+};
+
+struct CameraTrack {
+    KeyframeCurve position, lookAt;
+
+    bool empty() const {
+        return position.empty() && lookAt.empty();
+    }
+
+    float lastFrame() const {
+        return std::max(position.lastFrame(), lookAt.lastFrame());
+    }
+};
+
+#endif // KEYFRAMES_H
@@ -9,246 +9,126 @@
 #include <iostream>
 #include "point_light.h"
 #include "material.h"
+#include "mesh_loader.h"
+#include "scene.h"
+#include "scene_binary.h"
+#include "scene_sax.h"
+#include "render_stats.h"
+#include "cost_heatmap.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "optics.h"
+#include "tiles.h"
+#include "wavefront.h"
+#include "progressive.h"
+#include "denoiser.h"
+#include "animation.h"
+#include "frame_writer.h"
+#include "video_stream.h"
+#include "temporal.h"
+#include "render_server.h"
+#include "distributed.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <csignal>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <random>
+#include <sys/stat.h>
 
 
 using json = nlohmann::json;
 using namespace std;
 string rendermode;
+PathTermination termination;
 float t;
 
 
-Vec3 renderPixel(const PinholeCamera& camera, const std::vector<Sphere>& spheres,
-                 const std::vector<Cylinder>& cylinders, const std::vector<Triangle>& triangles,
-                 const std::vector<PointLight>& lights, int nbounces,
+Vec3 renderPixel(const PinholeCamera& camera, const Scene& scene, int nbounces,
                  float u, float v, int width, int height, const Ray& ray);
 
 
-Vec3 computeColor(const Ray& ray, const std::vector<Sphere>& spheres,
-                  const std::vector<Cylinder>& cylinders, const std::vector<Triangle>& triangles,
-                  const std::vector<PointLight>& lights, int nbounces);
+Vec3 computeColor(const Ray& ray, const Scene& scene, int nbounces, SurfaceGuide* guide = nullptr);
 
 Vec3 calculateShading(const Ray& ray, const Vec3& hit_point, const Vec3& normal, const Material& material,
-                      const std::vector<PointLight>& lights, int nbounces,
-                      const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders,
-                      const std::vector<Triangle>& triangles);
+                      const Scene& scene);
 
 
-// Function to generate a random float between 0 and 1
-float random_float() {
-    return static_cast<float>(rand()) / RAND_MAX;
+// Random engine of the calling thread, renderImage reseeds it for every tile
+std::mt19937& renderRandom() {
+    thread_local std::mt19937 generator;
+    return generator;
 }
 
-Vec3 reinhardToneMapping(const Vec3& color, float exposure) {
-    float L_w = 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;  // Luminance
-
-    // Tone mapping formula
-    Vec3 mappedColor = color * (exposure / (exposure + L_w));
-
-    // Optionally, you can perform gamma correction for display
-    float gamma = 2.2f;
-    mappedColor.x = std::pow(mappedColor.x, 1.0f / gamma);
-    mappedColor.y = std::pow(mappedColor.y, 1.0f / gamma);
-    mappedColor.z = std::pow(mappedColor.z, 1.0f / gamma);
-
-    return mappedColor;
+// Function to generate a random float between 0 and 1
+float random_float() {
+    return std::uniform_real_distribution<float>(0.0f, 1.0f)(renderRandom());
 }
 
 
-// Helper function to clamp the y-coordinate of an object's position within a specified range
-Vec3 clampPosition(const Vec3& position, float minY, float maxY) {
-    Vec3 clampedPosition = position;
-    clampedPosition.y = std::max(minY, std::min(maxY, position.y));
-    return clampedPosition;
+bool checkShadow(const Ray& shadow_ray, const Scene& scene) {
+    ++RenderStats::local().shadowRays;
+    TemporalReuse::trace(shadow_ray, 0.001f, 1.0f);
+    return scene.bvh.occluded(shadow_ray, 0.001f, 1.0f, scene.spheres, scene.cylinders, scene.triangles);
 }
 
-
-void renderImagesWithMovingObjects(const PinholeCamera& camera,
-                                   std::vector<Sphere>& spheres,
-                                   std::vector<Cylinder>& cylinders,
-                                   const std::vector<Triangle>& triangles,
-                                   const std::vector<PointLight>& lights,
-                                   int nbounces,
-                                   int numFrames,
-                                   const std::string& outputDirectory) {
-    Vec3 originalSpherePosition = spheres[0].center;
-    Vec3 originalCylinderPosition = cylinders[0].center;
-
-    // Define motion parameters
-    float sphereSpeed = 0.2f;  // Speed of the sphere
-    float cylinderSpeed = 0.1f;  // Speed of the cylinder
-    float maxYPosition = 1.0f;
-    float minYPosition = -0.5f;
-    float groundHeight = minYPosition + 0.1f;  // Adjust as needed
-    bool isDescending = true;  // Flag to indicate whether the sphere is descending
-
-    // Loop through different positions of the moving objects
-    for (int frame = 0; frame < numFrames; ++frame) {
-        // Calculate the new position of the sphere
-        float offsetY = (isDescending ? -1.0f : 1.0f) * sphereSpeed * std::sin(static_cast<float>(frame) * 0.1f);
-        Vec3 offset(0.0f, offsetY, 0.0f);
-
-        // Move the sphere to the new position
-        spheres[0].setCenter(originalSpherePosition + offset);
-
-        // Ensure the sphere stays within the camera range and above the ground
-        spheres[0].setCenter(clampPosition(spheres[0].center, minYPosition, maxYPosition));
-
-        // Calculate the new position of the cylinder
-        float offsetCylinderY = (isDescending ? 1.0f : -1.0f) * cylinderSpeed * std::sin(static_cast<float>(frame) * 0.1f);
-        Vec3 offsetCylinder(0.0f, offsetCylinderY, 0.0f);
-
-        // Move the cylinder to the new position
-        cylinders[0].setCenter(originalCylinderPosition + offsetCylinder);
-
-        // Ensure the cylinder stays within the camera range and above the ground
-        cylinders[0].setCenter(clampPosition(cylinders[0].center, minYPosition, maxYPosition));
-
-        // Check if the sphere is about to reach the ground
-        if (isDescending && spheres[0].center.y <= groundHeight) {
-            isDescending = false;  // Switch to ascending motion
-        }
-
-        // Render the scene
-        Vec3* image = new Vec3[camera.width * camera.height];
-
-        for (int j = 0; j < camera.height; ++j) {
-            for (int i = 0; i < camera.width; ++i) {
-                float u = static_cast<float>(i) / static_cast<float>(camera.width);
-                float v = 1.0f - static_cast<float>(j) / static_cast<float>(camera.height);
-                Ray ray = camera.generateRay(u, v);
-
-                Vec3 color = renderPixel(camera, spheres, cylinders, triangles, lights, nbounces, u, v, camera.width, camera.height, ray);
-
-                image[j * camera.width + i] = color;
-            }
+// Follows one path of up to nbounces hits. Every hit adds its local shading scaled by the
+// path throughput, then the path goes on with at most one reflected or refracted ray (see
+// continuePath()), so a sample costs one ray per bounce and runs in constant stack space.
+// guide, if given, receives the first hit's surface for the denoiser.
+Vec3 computeColor(const Ray& primary, const Scene& scene, int nbounces, SurfaceGuide* guide) {
+    Vec3 color(0.0f, 0.0f, 0.0f);
+    Vec3 throughput(1.0f, 1.0f, 1.0f);
+    Ray ray = primary;
+
+    for (int depth = nbounces; depth > 0; --depth) {
+        // Closest hit over spheres, cylinders, and triangles. The old per-type loops took any
+        // hit with t < closest, including ones behind the ray origin, and tMin keeps that.
+        BVHHit hit{};
+        if (!scene.bvh.intersect(ray, -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(),
+                                 scene.spheres, scene.cylinders, scene.triangles, hit)) {
+            TemporalReuse::trace(ray, -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity());
+            break;
         }
-
-        // Save the image with a filename indicating the frame number
-        std::ostringstream filename;
-        filename << outputDirectory << "/frame_" << frame << ".ppm";
-        ImageWriter::writePPM(filename.str().c_str(), camera.width, camera.height, image);
-
-        // Cleanup
-        delete[] image;
-    }
-
-    // Reset the positions of the moving objects
-    spheres[0].setCenter(originalSpherePosition);
-    cylinders[0].setCenter(originalCylinderPosition);
-}
-
-
-
-Vec3 reflect(const Vec3& incident, const Vec3& normal) {
-    return incident - 2.0f * Vec3::dot(incident, normal) * normal;
-}
-
-// Function to compute refraction direction (Snell's Law)
-Vec3 refract(const Vec3& incident, const Vec3& normal, float refractiveIndexRatio) {
-    float cos_theta = std::min(Vec3::dot(-incident, normal), 1.0f);
-    Vec3 perpendicular = refractiveIndexRatio * (incident + cos_theta * normal);
-    Vec3 parallel = -std::sqrt(std::abs(1.0f - perpendicular.length_squared())) * normal;
-    return perpendicular + parallel;
-}
-
-bool checkShadow(const Ray& shadow_ray, const std::vector<Sphere>& spheres,
-                 const std::vector<Cylinder>& cylinders, const std::vector<Triangle>& triangles) {
-    float t;
-    for (const auto& sphere : spheres) {
-        if (sphere.intersect(shadow_ray, t) && t > 0.001f && t < 1.0f) {
-            return true;
+        TemporalReuse::trace(ray, -std::numeric_limits<float>::infinity(), hit.t);
+
+        Vec3 hit_point = ray.origin + hit.t * ray.direction;
+        Vec3 normal;
+        Material material;
+        scene.surfaceAt(hit.primitive, hit_point, ray.time, normal, material);
+        if (guide && depth == nbounces) {
+            guide->albedo = material.diffusecolor;
+            guide->normal = normal;
+            guide->depth = hit.t;
         }
-    }
 
-    for (const auto& cylinder : cylinders) {
-        if (cylinder.intersect(shadow_ray, t) && t > 0.001f && t < 1.0f) {
-            return true;
-        }
-    }
+        color += throughput * calculateShading(ray, hit_point, normal, material, scene);
 
-    for (const auto& triangle : triangles) {
-        if (triangle.intersect(shadow_ray, t) && t > 0.001f && t < 1.0f) {
-            return true;
+        // Binary mode doesn't bounce, and a ray spawned at the last bounce would add nothing
+        if (rendermode != "phong" || depth == 1) {
+            break;
         }
-    }
-
-    return false;
-}
-
-Vec3 handleReflection(const Ray& ray, const Vec3& hit_point, const Vec3& normal, const Material& material,
-                      const std::vector<PointLight>& lights,
-                      int nbounces, const std::vector<Sphere>& spheres,
-                      const std::vector<Cylinder>& cylinders, const std::vector<Triangle>& triangles) {
-    Vec3 reflection_color(0.0f, 0.0f, 0.0f);
-
-    if (material.isreflective && material.reflectivity > 0.0f) {
-        Vec3 reflected_direction = reflect(ray.direction, normal).normalized();
-        Ray reflected_ray(hit_point + normal * 0.01f, reflected_direction);  // Increase the offset
-        reflection_color = material.reflectivity * computeColor(reflected_ray, spheres, cylinders, triangles, lights, nbounces - 1);
-    }
-
-    return reflection_color;
-}
-
-
-Vec3 handleRefraction(const Ray& ray, const Vec3& hit_point, const Vec3& normal, const Material& material,
-                      const std::vector<PointLight>& lights,int nbounces, const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders,
-                      const std::vector<Triangle>& triangles) {
-    Vec3 color(0.0f, 0.0f, 0.0f);
-
-    if (material.isrefractive && material.refractiveindex > 0.0f) {
-        Vec3 refracted_direction = refract(ray.direction, normal, 1.0f / material.refractiveindex).normalized();
-        Ray refracted_ray(hit_point - normal * 0.001f, refracted_direction);
-        color += (1.0f - material.reflectivity) * computeColor(refracted_ray, spheres, cylinders, triangles, lights, nbounces - 1);
-    }
-
-    return color;
-}
-
-
-Vec3 computeColor(const Ray& ray, const std::vector<Sphere>& spheres,
-                  const std::vector<Cylinder>& cylinders, const std::vector<Triangle>& triangles,
-                  const std::vector<PointLight>& lights, int nbounces) {
-    if (nbounces <= 0) {
-        // End recursion when reaching the maximum number of bounces
-        return Vec3(0.0f, 0.0f, 0.0f);
-    }
-
-    float t;
-    Vec3 color(0.0f, 0.0f, 0.0f);
-    Vec3 hit_point, normal;
-    float closest_hit = std::numeric_limits<float>::infinity();
 
-    // Iterate over spheres, cylinders, and triangles
-    for (const auto& sphere : spheres) {
-        if (sphere.intersect(ray, t) && t < closest_hit) {
-            closest_hit = t;
-            hit_point = ray.origin + t * ray.direction;
-            normal = sphere.normalAt(hit_point);
-            Material material = sphere.getMaterial();
-            color = calculateShading(ray, hit_point, normal, material, lights, nbounces, spheres, cylinders, triangles);
+        Ray next = ray;
+        float weight;
+        bool reflected;
+        if (!continuePath(ray, hit_point, normal, material, random_float(), next, weight, reflected)) {
+            break;
         }
-    }
-
-    for (const auto& cylinder : cylinders) {
-        if (cylinder.intersect(ray, t) && t < closest_hit) {
-            closest_hit = t;
-            hit_point = ray.origin + t * ray.direction;
-            normal = cylinder.normalAt(hit_point);
-            Material material = cylinder.getMaterial();
-            color = calculateShading(ray, hit_point, normal, material, lights, nbounces, spheres, cylinders, triangles);
+        throughput *= weight;
+        if (termination.enabled() && !termination.survives(nbounces - depth + 1, throughput, random_float())) {
+            ++RenderStats::local().terminatedPaths;
+            break;
         }
-    }
-
-    for (const auto& triangle : triangles) {
-        if (triangle.intersect(ray, t) && t < closest_hit) {
-            closest_hit = t;
-            hit_point = ray.origin + t * ray.direction;
-            normal = triangle.normal();
-            Material material = triangle.getMaterial();
-            color = calculateShading(ray, hit_point, normal, material, lights, nbounces, spheres, cylinders, triangles);
+        if (reflected) {
+            ++RenderStats::local().reflectionRays;
+        } else {
+            ++RenderStats::local().refractionRays;
         }
+        ray = next;
     }
 
     return color;
@@ -256,10 +136,10 @@ Vec3 computeColor(const Ray& ray, const std::vector<Sphere>& spheres,
 
 // ...
 
+// Local lighting at a hit, the bounces are followed by computeColor
 Vec3 calculateShading(const Ray& ray, const Vec3& hit_point, const Vec3& normal, const Material& material,
-                      const std::vector<PointLight>& lights, int nbounces,
-                      const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders,
-                      const std::vector<Triangle>& triangles) {
+                      const Scene& scene) {
+    ++RenderStats::local().shadingCalls;
     float ambient_factor = material.ka;
     Vec3 ambient = ambient_factor * material.diffusecolor;
     Vec3 color(0.0f, 0.0f, 0.0f);
@@ -267,14 +147,14 @@ Vec3 calculateShading(const Ray& ray, const Vec3& hit_point, const Vec3& normal,
     if (rendermode == "binary") {
         color = Vec3(1.0f, 0.0f, 0.0f);  // Red color
     } else if (rendermode == "phong") {
-        for (const auto& light : lights) {
+        for (const auto& light : scene.lights) {
             Vec3 light_direction = (light.position - hit_point).normalized();
             Vec3 view_direction = (ray.origin - hit_point).normalized();
             Vec3 halfway = (view_direction + light_direction).normalized();
 
             // Shadow check
-            Ray shadow_ray(hit_point + normal * 0.001f, light_direction);
-            bool in_shadow = checkShadow(shadow_ray, spheres, cylinders, triangles);
+            Ray shadow_ray(hit_point + normal * 0.001f, light_direction, ray.time);
+            bool in_shadow = checkShadow(shadow_ray, scene);
 
             if (!in_shadow) {
                 float diffuse_intensity = std::max(0.0f, Vec3::dot(normal, light_direction));
@@ -295,10 +175,10 @@ Vec3 calculateShading(const Ray& ray, const Vec3& hit_point, const Vec3& normal,
                     Vec3 light_sample_direction = (light_sample_point - hit_point).normalized();
 
                     // Compute shadow ray to the sampled point on the light
-                    Ray shadow_ray_sample(hit_point + normal * 0.001f, light_sample_direction);
+                    Ray shadow_ray_sample(hit_point + normal * 0.001f, light_sample_direction, ray.time);
 
                     // Check if the sampled point is visible from the hit point
-                    bool in_shadow_sample = checkShadow(shadow_ray_sample, spheres, cylinders, triangles);
+                    bool in_shadow_sample = checkShadow(shadow_ray_sample, scene);
 
                     if (!in_shadow_sample) {
                         // Adjust the intensity based on the distance between the hit point and the sampled point
@@ -312,13 +192,6 @@ Vec3 calculateShading(const Ray& ray, const Vec3& hit_point, const Vec3& normal,
                 }
             }
         }
-
-        // Handle reflection and refraction (recursive)
-        if (nbounces > 0) {
-            Vec3 reflection_color = handleReflection(ray, hit_point, normal, material, lights, nbounces, spheres, cylinders, triangles);
-            color += reflection_color;
-            color += handleRefraction(ray, hit_point, normal, material, lights, nbounces, spheres, cylinders, triangles);
-        }
     }
 
     return color;
@@ -332,9 +205,7 @@ Vec3 calculateShading(const Ray& ray, const Vec3& hit_point, const Vec3& normal,
 
 // Function to perform anti-aliased rendering
 // Function to perform anti-aliased rendering with lens sampling
-Vec3 renderPixel(const PinholeCamera& camera, const std::vector<Sphere>& spheres,
-                 const std::vector<Cylinder>& cylinders, const std::vector<Triangle>& triangles,
-                 const std::vector<PointLight>& lights, int nbounces,
+Vec3 renderPixel(const PinholeCamera& camera, const Scene& scene, int nbounces,
                  float u, float v, int width, int height, const Ray& ray) {
     const int num_samples = 10;  // You can adjust this value based on your anti-aliasing needs
     Vec3 color = Vec3(0.0f, 0.0f, 0.0f);
@@ -352,8 +223,16 @@ Vec3 renderPixel(const PinholeCamera& camera, const std::vector<Sphere>& spheres
         Vec3 new_direction = (focal_point - lens_point).normalized();
         // Ray new_ray(new_origin, new_direction);
 
+        // With motion blur every sample sees the scene at its own time in the shutter,
+        // one from each tenth of it
+        Ray sample = ray;
+        if (scene.motionBlur) {
+            sample.time = (static_cast<float>(i) + random_float()) / num_samples;
+        }
+
         // Compute color using the new ray
-        color += computeColor(ray, spheres, cylinders, triangles, lights, nbounces);
+        ++RenderStats::local().primaryRays;
+        color += computeColor(sample, scene, nbounces);
     }
 
     // Average the colors
@@ -364,183 +243,1039 @@ Vec3 renderPixel(const PinholeCamera& camera, const std::vector<Sphere>& spheres
     return color;
 }
 
-PinholeCamera parseCamera(const json& cameraConfig) {
-    Vec3 cameraPosition(cameraConfig["position"][0], cameraConfig["position"][1], cameraConfig["position"][2]);
-    Vec3 lookAt(cameraConfig["lookAt"][0], cameraConfig["lookAt"][1], cameraConfig["lookAt"][2]);
-    Vec3 upVector(cameraConfig["upVector"][0], cameraConfig["upVector"][1], cameraConfig["upVector"][2]);
-    float fov = cameraConfig["fov"];
-    double exposure = cameraConfig["exposure"];
-    int width = cameraConfig["width"];
-    int height = cameraConfig["height"];
-    float aperture = 0.1f;  // Default aperture value
-
-    return PinholeCamera(cameraPosition, lookAt, upVector, fov, exposure, width, height,aperture);
+// Renders one tile of the camera's view into image (width * height). The tile reseeds
+// the thread's random engines from seed and its tile index, so its pixels only depend on
+// the seed, not on the thread or on what else gets rendered.
+void renderTile(const PinholeCamera& camera, const Scene& scene, int nbounces, const TileGrid& tiles, size_t tile,
+                Vec3* image, CostHeatmap* heatmap, unsigned seed) {
+    const int width = camera.width;
+    const int height = camera.height;
+    TRACE_SCOPE_ARG("tile", "render", static_cast<int64_t>(tile));
+    unsigned tileSeed = TileGrid::seed(seed, tile);
+    renderRandom().seed(tileSeed);
+    PinholeCamera::seed(tileSeed);
+
+    TileRect rect = tiles.rect(tile);
+    for (int j = rect.y0; j < rect.y1; ++j) {  // Change loop condition to start from the top
+        for (int i = rect.x0; i < rect.x1; ++i) {
+            float u = static_cast<float>(i) / static_cast<float>(width);
+            float v = 1.0f - static_cast<float>(j) / static_cast<float>(height);
+            CostHeatmap::Sample cost;
+            if (heatmap) {
+                cost = CostHeatmap::begin();
+            }
+            Ray ray = camera.generateRay(u, v);
+            Vec3 color = renderPixel(camera, scene, nbounces, u, v, width, height,ray);
+            if (heatmap) {
+                heatmap->end(i, j, cost);
+            }
+            if (rendermode =="phong")
+            {
+            color+=scene.backgroundColor;
+            }
+            image[j * width + i] = color;
+        }
+    }
 }
-// set the back ground color to black
 
-Material parseMaterial(const nlohmann::json& shapeConfig) {
-    if (shapeConfig.find("material") != shapeConfig.end()) {
-        return Material(shapeConfig["material"]);
-    } else {
-        // If no material is specified, create a default material
-        return Material(0.0f, 0.0f,0.0f, 1.0f, Vec3(0.0f, 0.0f, 0.0f), Vec3(0.0f, 0.0f, 0.0f), false, 0.0f, false, 1.0f);
+// Render the camera's view into image (width * height) in square tiles spread over the pool.
+// A fixed seed gives the same image whatever the number of threads.
+void renderImage(ThreadPool& pool, const PinholeCamera& camera, const Scene& scene, int nbounces,
+                 Vec3* image, CostHeatmap* heatmap, unsigned seed) {
+    TileGrid tiles(camera.width, camera.height);
+    pool.parallelFor(tiles.count(), [&](size_t tile) {
+        renderTile(camera, scene, nbounces, tiles, tile, image, heatmap, seed);
+    });
+}
+
+// Renders the view of every camera of the scene to outputDirectory/view_<n>.ppm. The
+// tiles of all views go through one parallelFor, so a thread done with the tiles of one
+// view goes on with the next instead of waiting for the view's last tile. Every view
+// gets the same seed and comes out as if its camera had been rendered alone. A view's
+// image is allocated when its first tile starts and written and freed by the thread
+// that finishes its last tile; tiles are handed out in order, so only the views being
+// worked on take memory.
+void renderViews(ThreadPool& pool, const Scene& scene, int nbounces, const std::string& outputDirectory,
+                 unsigned seed) {
+    struct View {
+        TileGrid tiles;
+        std::vector<Vec3> image;
+        std::once_flag allocated;
+        std::atomic<size_t> tilesLeft;
+
+        View(const PinholeCamera& camera) : tiles(camera.width, camera.height), tilesLeft(tiles.count()) {}
+    };
+    std::vector<std::unique_ptr<View>> views;
+    std::vector<size_t> firstTiles;  // per view, where its tiles start in the one range of all
+    size_t tileCount = 0;
+    for (const PinholeCamera& camera : scene.cameras) {
+        views.emplace_back(new View(camera));
+        firstTiles.push_back(tileCount);
+        tileCount += views.back()->tiles.count();
     }
+    mkdir(outputDirectory.c_str(), 0755);
+
+    pool.parallelFor(tileCount, [&](size_t job) {
+        size_t v = static_cast<size_t>(std::upper_bound(firstTiles.begin(), firstTiles.end(), job) - firstTiles.begin()) - 1;
+        View& view = *views[v];
+        const PinholeCamera& camera = scene.cameras[v];
+        std::call_once(view.allocated, [&] { view.image.resize(static_cast<size_t>(camera.width) * camera.height); });
+        renderTile(camera, scene, nbounces, view.tiles, job - firstTiles[v], view.image.data(), nullptr, seed);
+
+        // The last tile's thread sees the pixels of all the others through the counter
+        if (view.tilesLeft.fetch_sub(1) == 1) {
+            TRACE_SCOPE_ARG("write view", "io", static_cast<int64_t>(v));
+            std::ostringstream filename;
+            filename << outputDirectory << "/view_" << v << ".ppm";
+            ImageWriter::writePPM(filename.str().c_str(), camera.width, camera.height, view.image.data());
+            std::vector<Vec3>().swap(view.image);
+        }
+    });
 }
 
+// Frames being built or rendered at once. Two are enough to overlap building the next
+// frame's BVH with rendering, the tiles keep every thread busy.
+const size_t framesInFlight = 2;
 
-void parseShapes(const json& shapesConfig, std::vector<Sphere>& spheres, std::vector<Cylinder>& cylinders, std::vector<Triangle>& triangles) {
-    // Use a map to store shapes based on their type
-    std::map<std::string, std::vector<json>> shapeMap;
+// Animation settings, see renderImagesWithMovingObjects()
+struct AnimationSettings {
+    int frames = 0;
+    std::string outputDirectory = "output_images";
+    size_t writeQueue = 4;                              // finished frames waiting to be written
+    std::string videoFile;                              // a stream instead of PPMs, "-" is stdout
+    VideoStream::Format videoFormat = VideoStream::Y4M;
+    int fps = 24;
+    bool reuse = false;                                 // only render tiles that can see a change
+    bool verifyReuse = false;                           // and check them against full renders
+    float shutter = 0.0f;                               // motion blur over this part of a frame
+};
+
+// Renders the frames of the scene's keyframe animation, or of the bobbing sphere/cylinder
+// for scenes without keyframes, to outputDirectory/frame_<n>.ppm or as one video stream
+// to videoFile. Every frame is a snapshot of scene with the objects and the camera
+// moved, held in one of framesInFlight slots together with its BVH scratch arena. A
+// slot builds its BVH for its first frame and refits it for the ones after, until the
+// tree has degraded past bvhRebuildGrowth. Slots take the next frame as soon as they are
+// free, and each frame's tiles go to the shared pool, so the tiles of neighbouring
+// frames interleave. Finished frames go to a FrameWriter, which encodes and writes them
+// in order on its own thread with up to writeQueue frames waiting. scene itself is not
+// modified.
+//
+// With reuse, frames are rendered one after another with the same seed and only the
+// tiles TemporalReuse finds dirty are rendered again, the rest are kept from the frame
+// before. verifyReuse renders every frame in full as well and throws if any pixel
+// differs.
+//
+// With a shutter, a frame's snapshot also holds where the objects are that part of a
+// frame later and every sample is traced at its own time in between (motion blur).
+void renderImagesWithMovingObjects(ThreadPool& pool,
+                                   const PinholeCamera& camera,
+                                   const Scene& scene,
+                                   int nbounces,
+                                   const AnimationSettings& settings,
+                                   unsigned seed) {
+    const int numFrames = settings.frames;
+    const size_t writeQueue = settings.writeQueue;
+    std::unique_ptr<Motion> motion;
+    if (scene.animated()) {
+        motion.reset(new KeyframeMotion(scene));
+    } else {
+        motion.reset(new BobbingMotion(scene, numFrames));
+    }
 
-    // Collect all shapes based on their type
-    for (const auto& shape : shapesConfig) {
-        if (!shape.contains("type")) {
-            std::cerr << "Error: Shape does not have a 'type' key.\n";
-            continue;
-        }
+    std::unique_ptr<VideoStream> video;
+    if (!settings.videoFile.empty()) {
+        video.reset(new VideoStream(settings.videoFile, settings.videoFormat, camera.width, camera.height, settings.fps));
+    } else {
+        mkdir(settings.outputDirectory.c_str(), 0755);
+    }
 
-        std::string type = shape["type"];
-        shapeMap[type].emplace_back(shape);
+    // Slots are refilled frame after frame, so after its first frame a slot reuses its
+    // vectors and arena blocks instead of allocating
+    struct FrameSlot {
+        Scene snapshot;
+        Scene closing;  // the snapshot when the shutter closes, for motion blur
+        Arena scratch;
+        ArenaStats nodeStatsAfterFirstFrame, scratchStatsAfterFirstFrame;
+        int framesRendered = 0;
+        int rebuilds = 0;
+    };
+    size_t slotCount = settings.reuse ? 1 : std::min(framesInFlight, static_cast<size_t>(std::max(numFrames, 1)));
+    std::vector<std::unique_ptr<FrameSlot>> slots;
+    for (size_t i = 0; i < slotCount; ++i) {
+        slots.emplace_back(new FrameSlot());
     }
 
-    // Process spheres
-    for (const auto& sphereConfig : shapeMap["sphere"]) {
-        Material sphereMaterial = parseMaterial(sphereConfig); // Parse material for sphere
-        Sphere sphere(sphereConfig, sphereMaterial);
-        spheres.emplace_back(sphere);
-        // print sphere confgi
-        // cout<<"sphere config: "<<sphereConfig<<endl;
+    // Every slot holds a framebuffer while it renders, the rest make up the queue
+    FrameWriter writer(camera.width, camera.height, numFrames, slotCount + writeQueue, [&](const FrameWriter::Frame& frame) {
+        if (video) {
+            video->writeFrame(frame.pixels.data());
+            return;
+        }
+        // Save the image with a filename indicating the frame number
+        std::ostringstream filename;
+        filename << settings.outputDirectory << "/frame_" << frame.index << ".ppm";
+        ImageWriter::writePPM(filename.str().c_str(), camera.width, camera.height, frame.pixels.data());
+    });
+
+    // A frame builds on the one before, the image is kept up to date across frames
+    TileGrid tiles(camera.width, camera.height);
+    std::unique_ptr<TemporalReuse> reuse;
+    std::vector<Vec3> reusedImage, fullImage;
+    size_t tilesRendered = 0, differingPixels = 0;
+    float largestDifference = 0.0f;
+    if (settings.reuse) {
+        reuse.reset(new TemporalReuse(tiles.count(), motion->frameChanges(scene, numFrames, settings.shutter)));
+        reusedImage.resize(static_cast<size_t>(camera.width) * camera.height);
     }
 
-    // Process cylinders
-    for (const auto& cylinderConfig : shapeMap["cylinder"]) {
-        Material cylinderMaterial = parseMaterial(cylinderConfig); // Parse material for cylinder
-        Cylinder cylinder(cylinderConfig, cylinderMaterial);
-        cylinders.emplace_back(cylinder);
-        // cout<<"cylinder config: "<<cylinderConfig<<endl;
+    pool.parallelFor(slotCount, [&](size_t s) {
+        FrameSlot& slot = *slots[s];
+        while (FrameWriter::Frame* output = writer.acquire()) {
+            const int frame = output->index;
+            TRACE_SCOPE_ARG("frame", "animation", frame);
+            copySceneContents(scene, slot.snapshot);
+            motion->applyShutter(slot.snapshot, static_cast<float>(frame), settings.shutter, scene, slot.closing);
+            const PinholeCamera& frameCamera = slot.snapshot.cameras.empty() ? camera : slot.snapshot.cameras[0];
+
+            // Refit the BVH to the moved objects, rebuild it once refitting made it too loose
+            if (slot.framesRendered == 0 || slot.snapshot.refitBVH() > bvhRebuildGrowth) {
+                slot.scratch.reset();
+                slot.snapshot.buildBVH(slot.scratch);
+                ++slot.rebuilds;
+            }
+
+            if (reuse) {
+                std::vector<size_t> dirty = reuse->dirtyTiles(frame);
+                pool.parallelFor(dirty.size(), [&](size_t d) {
+                    TemporalReuse::Recording recording(*reuse, dirty[d], frame);
+                    renderTile(frameCamera, slot.snapshot, nbounces, tiles, dirty[d], reusedImage.data(), nullptr, seed);
+                });
+                tilesRendered += dirty.size();
+                std::copy(reusedImage.begin(), reusedImage.end(), output->pixels.begin());
+
+                if (settings.verifyReuse) {
+                    fullImage.resize(reusedImage.size());
+                    renderImage(pool, frameCamera, slot.snapshot, nbounces, fullImage.data(), nullptr, seed);
+                    size_t differing = 0;
+                    for (size_t i = 0; i < fullImage.size(); ++i) {
+                        Vec3 difference = fullImage[i] - reusedImage[i];
+                        float largest = std::max(std::abs(difference.x), std::max(std::abs(difference.y), std::abs(difference.z)));
+                        if (largest > 0.0f) {
+                            ++differing;
+                            largestDifference = std::max(largestDifference, largest);
+                        }
+                    }
+                    if (differing > 0) {
+                        std::cerr << "Temporal reuse: frame " << frame << " differs from a full render in "
+                                  << differing << " pixels\n";
+                    }
+                    differingPixels += differing;
+                }
+            } else {
+                // Frames get seeds of their own, the tiles derive theirs from it
+                unsigned frameSeed = seed ^ (static_cast<unsigned>(frame) * 0x68E31DA4u);
+                renderImage(pool, frameCamera, slot.snapshot, nbounces, output->pixels.data(), nullptr, frameSeed);
+            }
+            writer.submit(output);
 
+            if (slot.framesRendered++ == 0) {
+                slot.nodeStatsAfterFirstFrame = slot.snapshot.bvh.arenaStats();
+                slot.scratchStatsAfterFirstFrame = slot.scratch.stats();
+            }
+        }
+    });
+    writer.finish();
+    if (video) {
+        video->finish();
     }
 
-    // Process triangles
-    for (const auto& triangleConfig : shapeMap["triangle"]) {
-        Material triangleMaterial = parseMaterial(triangleConfig); // Parse material for triangle
-        Triangle triangle(triangleConfig, triangleMaterial);
-        triangles.emplace_back(triangle);
-        // cout<<"triangle config: "<<triangleConfig<<endl;
+    // Steady state check: the arenas should have stopped growing after each slot's first frame
+    size_t nodeAllocations = 0, scratchAllocations = 0;
+    int rebuilds = 0;
+    for (const auto& slot : slots) {
+        rebuilds += slot->rebuilds;
+        if (slot->framesRendered > 0) {
+            nodeAllocations += slot->snapshot.bvh.arenaStats().heapAllocations - slot->nodeStatsAfterFirstFrame.heapAllocations;
+            scratchAllocations += slot->scratch.stats().heapAllocations - slot->scratchStatsAfterFirstFrame.heapAllocations;
+        }
+    }
+    cout << "Animation: " << numFrames << " frames, " << slotCount << " in flight. Arena heap allocations after the"
+         << " first frame of a slot: BVH nodes " << nodeAllocations << ", frame scratch " << scratchAllocations
+         << ". BVH built " << rebuilds << " times, refitted " << numFrames - rebuilds << endl;
+
+    FrameWriterStats writes = writer.stats();
+    cout << std::fixed << std::setprecision(1)
+         << "Frame writer: " << writes.framesWritten << " frames in " << writes.writeMs << " ms, queue depth mean "
+         << writes.meanQueueDepth << " max " << writes.maxQueueDepth << " (" << slotCount + writeQueue << " framebuffers)"
+         << ", rendering stalled " << writes.stalls << " times for " << writes.stallMs << " ms" << endl;
+    if (reuse) {
+        size_t tileTotal = tiles.count() * static_cast<size_t>(numFrames);
+        cout << "Temporal reuse: rendered " << tilesRendered << " of " << tileTotal << " tiles ("
+             << 100.0 * tilesRendered / std::max<size_t>(tileTotal, 1) << "%)" << endl;
+    }
+    cout.unsetf(std::ios::fixed);
+    cout << std::setprecision(6);
+
+    if (settings.verifyReuse) {
+        if (differingPixels > 0) {
+            std::ostringstream message;
+            message << "Temporal reuse differs from full renders in " << differingPixels
+                    << " pixels, by up to " << largestDifference;
+            throw std::runtime_error(message.str());
+        }
+        cout << "Temporal reuse verified: every frame matches a full render" << endl;
     }
 }
 
-static std::vector<PointLight> parseLights(const nlohmann::json& sceneConfig) {
-        std::vector<PointLight> lights;
+// Progressive render settings, see renderProgressive()
+struct ProgressiveSettings {
+    uint32_t samples = 0;            // samples per pixel to reach
+    double timeBudgetMs = 0.0;       // stop at this wall time instead, 0: no budget
+    std::string checkpointFile;      // empty: no checkpoints
+    double checkpointSeconds = 60.0;  // time between checkpoints
+    uint32_t previewPasses = 0;      // write output.ppm every this many passes, 0: only at the end
+    std::string resumeFile;          // checkpoint to continue from
+    uint64_t sceneHash = 0;          // of the scene file, checkpoints only resume on the same one
+};
+
+// Set by SIGINT/SIGTERM during a progressive render, which then finishes the tiles in
+// flight, checkpoints and stops
+volatile std::sig_atomic_t stopRequested = 0;
+
+void requestStop(int) {
+    stopRequested = 1;
+}
 
-        if (sceneConfig.find("lightsources") != sceneConfig.end() && sceneConfig["lightsources"].is_array()) {
-            for (const auto& lightConfig : sceneConfig["lightsources"]) {
-                if (!lightConfig.contains("type")) {
-                    std::cerr << "Error: Light source does not have a 'type' key.\n";
-                    continue;
+// One progressive pass: a path per pixel added to accumulation. Tiles are seeded from the
+// pass, so a resumed render draws the same samples as one that never stopped. Tiles that
+// would start after deadline or a stop request are skipped, the ones in flight finish.
+// With guides the first hits are recorded for the denoiser.
+void renderPass(ThreadPool& pool, const PinholeCamera& camera, const Scene& scene, int nbounces,
+                Accumulation& accumulation, std::chrono::steady_clock::time_point deadline,
+                Denoiser* guides = nullptr) {
+    const int width = camera.width;
+    const int height = camera.height;
+    TileGrid tiles(width, height);
+    unsigned passSeed = Accumulation::passSeed(accumulation.seed, accumulation.passes);
+
+    pool.parallelFor(tiles.count(), [&](size_t tile) {
+        if (stopRequested || std::chrono::steady_clock::now() >= deadline) {
+            return;
+        }
+        TRACE_SCOPE_ARG("tile", "render", static_cast<int64_t>(tile));
+        unsigned tileSeed = TileGrid::seed(passSeed, tile);
+        renderRandom().seed(tileSeed);
+        PinholeCamera::seed(tileSeed);
+
+        TileRect rect = tiles.rect(tile);
+        for (int j = rect.y0; j < rect.y1; ++j) {
+            for (int i = rect.x0; i < rect.x1; ++i) {
+                float u = static_cast<float>(i) / static_cast<float>(width);
+                float v = 1.0f - static_cast<float>(j) / static_cast<float>(height);
+                Ray ray = camera.generateRay(u, v);
+                if (scene.motionBlur) {
+                    ray.time = random_float();
                 }
-
-                std::string type = lightConfig["type"];
-
-                if (type == "pointlight") {
-                    lights.emplace_back(lightConfig);
+                ++RenderStats::local().primaryRays;
+                size_t pixel = static_cast<size_t>(j) * width + i;
+                if (guides) {
+                    SurfaceGuide guide;
+                    accumulation.add(pixel, computeColor(ray, scene, nbounces, &guide));
+                    guides->setGuide(pixel, guide);
                 } else {
-                    std::cerr << "Error: Unsupported light type: " << type << "\n";
+                    accumulation.add(pixel, computeColor(ray, scene, nbounces));
                 }
             }
         }
+    });
+    ++accumulation.passes;
+}
 
-        return lights;
+// The accumulated mean as an image, denoised if a denoiser is given and with the
+// background added like renderImage() does
+void resolveImage(const Scene& scene, const Accumulation& accumulation, Vec3* image, Denoiser* denoiser = nullptr) {
+    size_t pixels = static_cast<size_t>(accumulation.width) * accumulation.height;
+    for (size_t i = 0; i < pixels; ++i) {
+        image[i] = accumulation.resolve(i);
     }
+    if (denoiser) {
+        uint32_t fewest, most;
+        double mean;
+        accumulation.sampleRange(fewest, mean, most);
+        denoiser->denoise(image, mean);
+    }
+    if (rendermode == "phong") {
+        for (size_t i = 0; i < pixels; ++i) {
+            image[i] += scene.backgroundColor;
+        }
+    }
+}
 
-Vec3 parseBackgroundColor(const json& sceneConfig) {
-    Vec3 defaultColor = {0.0f, 0.0f, 0.0f}; // Default color if not specified
+// Renders pass after pass until settings.samples per pixel or, with a time budget, until
+// the budget is used up; the first pass always completes so no pixel is left empty.
+// Checkpoints and previews are written on the way and SIGINT/SIGTERM stop the render
+// with a checkpoint. Leaves the current image in image, denoised when a denoiser is
+// given, and returns false if a signal stopped it.
+bool renderProgressive(ThreadPool& pool, const PinholeCamera& camera, const Scene& scene, int nbounces,
+                       Vec3* image, const ProgressiveSettings& settings, unsigned seed, Denoiser* denoiser) {
+    RenderSource source;
+    source.sceneHash = settings.sceneHash;
+    source.cameraHash = RenderSource::hashCamera(camera);
+    source.nbounces = static_cast<uint32_t>(nbounces);
+    source.rendermode = rendermode;
+
+    Accumulation accumulation(camera.width, camera.height, seed);
+    accumulation.source = source;
+    if (!settings.resumeFile.empty()) {
+        accumulation = Accumulation::readCheckpoint(settings.resumeFile);
+        if (accumulation.width != camera.width || accumulation.height != camera.height) {
+            throw std::runtime_error("Checkpoint is " + std::to_string(accumulation.width) + "x" +
+                                     std::to_string(accumulation.height) + ", the camera renders " +
+                                     std::to_string(camera.width) + "x" + std::to_string(camera.height));
+        }
+        std::string difference = accumulation.source.difference(source);
+        if (!difference.empty()) {
+            throw std::runtime_error("Checkpoint " + settings.resumeFile + " doesn't match this render, " + difference);
+        }
+        cout << "Resuming " << settings.resumeFile << " at " << accumulation.passes << " spp" << endl;
+    }
+
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    auto start = std::chrono::steady_clock::now();
+    auto lastCheckpoint = start;
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    if (settings.timeBudgetMs > 0.0) {
+        deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                               std::chrono::duration<double, std::milli>(settings.timeBudgetMs));
+    }
+    uint32_t firstPass = accumulation.passes;
 
-    if (sceneConfig.find("backgroundcolor") != sceneConfig.end() && sceneConfig["backgroundcolor"].is_array() && sceneConfig["backgroundcolor"].size() == 3) {
-        // Extract RGB values from the JSON array
-        return {
-            sceneConfig["backgroundcolor"][0],
-            sceneConfig["backgroundcolor"][1],
-            sceneConfig["backgroundcolor"][2]
-        };
+    while (accumulation.passes < settings.samples && !stopRequested) {
+        // Pixels need a sample, and the guides a full pass, before the budget may cut one
+        bool mustComplete = accumulation.passes == 0 || (denoiser && accumulation.passes == firstPass);
+        if (!mustComplete && std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+        // The guides don't change between passes, so the first pass of this run records them
+        renderPass(pool, camera, scene, nbounces, accumulation,
+                   mustComplete ? std::chrono::steady_clock::time_point::max() : deadline,
+                   accumulation.passes == firstPass ? denoiser : nullptr);
+
+        if (settings.previewPasses > 0 && accumulation.passes % settings.previewPasses == 0 &&
+            accumulation.passes < settings.samples) {
+            TRACE_SCOPE("write preview", "io");
+            resolveImage(scene, accumulation, image, denoiser);
+            ImageWriter::writePPM("output.ppm", camera.width, camera.height, image);
+            cout << "Preview at " << accumulation.passes << " spp" << endl;
+        }
+
+        std::chrono::duration<double> sinceCheckpoint = std::chrono::steady_clock::now() - lastCheckpoint;
+        if (!settings.checkpointFile.empty() && sinceCheckpoint.count() >= settings.checkpointSeconds) {
+            TRACE_SCOPE("write checkpoint", "io");
+            accumulation.writeCheckpoint(settings.checkpointFile);
+            lastCheckpoint = std::chrono::steady_clock::now();
+        }
+    }
+
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    bool finished = !stopRequested;
+
+    if (settings.timeBudgetMs > 0.0) {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        uint32_t fewest, most;
+        double mean;
+        accumulation.sampleRange(fewest, mean, most);
+        cout << "Time budget " << settings.timeBudgetMs << " ms: " << accumulation.passes - firstPass
+             << " passes in " << elapsed.count() << " ms, spp min " << fewest << " mean " << mean
+             << " max " << most << endl;
+    }
+
+    if (!settings.checkpointFile.empty()) {
+        accumulation.writeCheckpoint(settings.checkpointFile);
+        cout << "Checkpoint at " << accumulation.passes << " spp: " << settings.checkpointFile << endl;
+    }
+    if (!finished) {
+        cout << "Stopped at " << accumulation.passes << " of " << settings.samples << " spp";
+        if (!settings.checkpointFile.empty()) {
+            cout << ", continue with --resume " << settings.checkpointFile;
+        }
+        cout << endl;
+    }
+    if (denoiser) {
+        ScopedTimer timer("denoise");
+        resolveImage(scene, accumulation, image, denoiser);
     } else {
-        std::cerr << "Warning: Using default background color.\n";
-        return defaultColor;
+        resolveImage(scene, accumulation, image);
     }
+    return finished;
 }
 
+// Root mean square difference of two tone mapped images
+double imageError(const std::vector<Vec3>& a, const std::vector<Vec3>& b) {
+    double sum = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        Vec3 d = a[i] - b[i];
+        sum += d.x * d.x + d.y * d.y + d.z * d.z;
+    }
+    return a.empty() ? 0.0 : std::sqrt(sum / (3.0 * a.size()));
+}
 
+// Time against error with and without the denoiser (--denoise-bench). Renders a
+// reference at 4x maxSamples spp from another seed, then one progressive render up to
+// maxSamples, and at every power of two spp prints the render time so far and the error
+// of the raw and the denoised image against the reference. Leaves the denoised image at
+// maxSamples in output, like renderProgressive() with a denoiser.
+void runDenoiseBenchmark(ThreadPool& pool, const PinholeCamera& camera, const Scene& scene, int nbounces,
+                         uint32_t maxSamples, Vec3* output, unsigned seed) {
+    const auto noDeadline = std::chrono::steady_clock::time_point::max();
+    const size_t pixels = static_cast<size_t>(camera.width) * camera.height;
+
+    cout << "Rendering the reference at " << 4 * maxSamples << " spp" << endl;
+    Accumulation reference(camera.width, camera.height, seed ^ 0x5BD1E995u);
+    for (uint32_t pass = 0; pass < 4 * maxSamples; ++pass) {
+        renderPass(pool, camera, scene, nbounces, reference, noDeadline);
+    }
+    std::vector<Vec3> referenceImage(pixels);
+    for (size_t i = 0; i < pixels; ++i) {
+        referenceImage[i] = reference.resolve(i);
+    }
 
-int main() {
-    std::ifstream ifs("scene_phong.json");
-    if (!ifs.is_open()) {
-        std::cerr << "Error opening JSON file\n";
-        return 1;
+    Denoiser denoiser(pool, camera.width, camera.height);
+    Accumulation accumulation(camera.width, camera.height, seed);
+    std::vector<Vec3> image(pixels);
+    double renderMs = 0.0;
+
+    cout << std::fixed << std::setprecision(3);
+    cout << std::setw(8) << "spp" << std::setw(12) << "render ms" << std::setw(12) << "raw RMSE"
+         << std::setw(12) << "denoise ms" << std::setw(12) << "total ms" << std::setw(14) << "denoised RMSE" << "\n";
+    for (uint32_t samples = 1; samples <= maxSamples; ++samples) {
+        auto start = std::chrono::steady_clock::now();
+        renderPass(pool, camera, scene, nbounces, accumulation, noDeadline, samples == 1 ? &denoiser : nullptr);
+        renderMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if ((samples & (samples - 1)) != 0 && samples != maxSamples) {
+            continue;
+        }
+
+        for (size_t i = 0; i < pixels; ++i) {
+            image[i] = accumulation.resolve(i);
+        }
+        double rawError = imageError(image, referenceImage);
+        start = std::chrono::steady_clock::now();
+        denoiser.denoise(image.data(), samples);
+        double denoiseMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        cout << std::setw(8) << samples << std::setw(12) << renderMs << std::setw(12) << rawError
+             << std::setw(12) << denoiseMs << std::setw(12) << renderMs + denoiseMs
+             << std::setw(14) << imageError(image, referenceImage) << "\n";
     }
+    cout.unsetf(std::ios::fixed);
+    cout << std::setprecision(6) << std::flush;
+    resolveImage(scene, accumulation, output, &denoiser);
+}
 
-    json config;
-    ifs >> config;
+// Load a scene file: .rtsc files go through the binary loader, everything else is read as JSON
+Scene loadScene(const std::string& filename) {
+    const std::string binaryExtension = ".rtsc";
+    if (filename.size() >= binaryExtension.size() &&
+        filename.compare(filename.size() - binaryExtension.size(), binaryExtension.size(), binaryExtension) == 0) {
+        return BinarySceneFile(filename).toScene();
+    }
+    return JsonSceneLoader::load(filename);
+}
 
-    // Add checks to print or log JSON content
-    //std::cout << "Config JSON:\n" << config.dump(2) << std::endl;
 
-    const int width = config["camera"]["width"];
-    const int height = config["camera"]["height"];
 
-    Vec3* image = new Vec3[width * height];
+int main(int argc, char* argv[]) {
+    std::string sceneFile = "scene_phong.json";
 
-    // Initialize camera
-    PinholeCamera camera = parseCamera(config["camera"]);
+    // Convert a JSON scene to the binary format and exit
+    if (argc >= 2 && std::string(argv[1]) == "--convert") {
+        if (argc < 4) {
+            std::cerr << "Usage: " << argv[0] << " --convert <scene.json> <scene.rtsc>\n";
+            return 1;
+        }
+        try {
+            Scene scene = JsonSceneLoader::load(argv[2]);
+            if (scene.animated()) {
+                std::cerr << "Warning: the binary format doesn't store keyframes, the animation is dropped\n";
+            }
+            BinarySceneWriter::write(scene, argv[3]);
+            cout << "Scene converted: " << argv[3] << endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
 
-    // Create shapes based on the information in the JSON file
-    std::vector<Sphere> spheres;
-    std::vector<Cylinder> cylinders;
-    std::vector<Triangle> triangles;
+    std::string statsFile;
+    std::string traceFile;
+    std::string integrator = "recursive";
+    WavefrontIntegrator::RaySort raySort = WavefrontIntegrator::SORT_AUTO;
+    size_t threads = 0;
+    ProgressiveSettings progressive;
+    AnimationSettings animation;
+    bool denoise = false;
+    uint32_t denoiseBenchSamples = 0;
+    bool writeHeatmap = false;
+    std::string serveSocket;
+    size_t sceneCacheSize = 8;
+    std::string workerAddress;                // --worker: render tiles for a coordinator
+    std::vector<std::string> workerAddresses;  // --workers: have these render the frame
+    bool fixedSeed = false;
+    unsigned seed = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--stats-json" && i + 1 < argc) {
+            statsFile = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::stoul(argv[++i]);
+        } else if (arg == "--trace" && i + 1 < argc) {
+            traceFile = argv[++i];
+        } else if (arg == "--integrator" && i + 1 < argc) {
+            integrator = argv[++i];
+            if (integrator != "recursive" && integrator != "wavefront") {
+                std::cerr << "Unknown integrator: " << integrator << " (recursive or wavefront)\n";
+                return 1;
+            }
+        } else if (arg == "--ray-sort" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "on") {
+                raySort = WavefrontIntegrator::SORT_ON;
+            } else if (mode == "off") {
+                raySort = WavefrontIntegrator::SORT_OFF;
+            } else if (mode == "auto") {
+                raySort = WavefrontIntegrator::SORT_AUTO;
+            } else {
+                std::cerr << "Unknown ray sort mode: " << mode << " (on, off or auto)\n";
+                return 1;
+            }
+        } else if (arg == "--roulette" && i + 1 < argc) {
+            termination.rouletteDepth = std::stoi(argv[++i]);
+            if (termination.rouletteDepth < 0) {
+                std::cerr << "--roulette needs a depth of 0 or more\n";
+                return 1;
+            }
+        } else if (arg == "--cutoff" && i + 1 < argc) {
+            termination.cutoff = std::stof(argv[++i]);
+            if (termination.cutoff < 0.0f || termination.cutoff >= 1.0f) {
+                std::cerr << "--cutoff needs a throughput in [0, 1)\n";
+                return 1;
+            }
+        } else if (arg == "--progressive" && i + 1 < argc) {
+            progressive.samples = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--time-budget" && i + 1 < argc) {
+            progressive.timeBudgetMs = std::stod(argv[++i]);
+            if (progressive.timeBudgetMs <= 0.0) {
+                std::cerr << "--time-budget needs a positive number of milliseconds\n";
+                return 1;
+            }
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            progressive.checkpointFile = argv[++i];
+        } else if (arg == "--checkpoint-interval" && i + 1 < argc) {
+            progressive.checkpointSeconds = std::stod(argv[++i]);
+        } else if (arg == "--preview-interval" && i + 1 < argc) {
+            progressive.previewPasses = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--resume" && i + 1 < argc) {
+            progressive.resumeFile = argv[++i];
+        } else if (arg == "--animate" && i + 1 < argc) {
+            animation.frames = std::stoi(argv[++i]);
+        } else if (arg == "--output-dir" && i + 1 < argc) {
+            animation.outputDirectory = argv[++i];
+        } else if (arg == "--write-queue" && i + 1 < argc) {
+            animation.writeQueue = std::stoul(argv[++i]);
+        } else if (arg == "--video" && i + 1 < argc) {
+            animation.videoFile = argv[++i];
+        } else if (arg == "--reuse") {
+            animation.reuse = true;
+        } else if (arg == "--verify-reuse") {
+            animation.reuse = true;
+            animation.verifyReuse = true;
+        } else if (arg == "--video-format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format == "y4m") {
+                animation.videoFormat = VideoStream::Y4M;
+            } else if (format == "rgb") {
+                animation.videoFormat = VideoStream::RAW_RGB;
+            } else {
+                std::cerr << "Unknown video format: " << format << " (y4m or rgb)\n";
+                return 1;
+            }
+        } else if (arg == "--fps" && i + 1 < argc) {
+            animation.fps = std::stoi(argv[++i]);
+            if (animation.fps <= 0) {
+                std::cerr << "--fps needs a positive frame rate\n";
+                return 1;
+            }
+        } else if (arg == "--motion-blur" && i + 1 < argc) {
+            animation.shutter = std::stof(argv[++i]);
+            if (animation.shutter <= 0.0f || animation.shutter > 1.0f) {
+                std::cerr << "--motion-blur needs a shutter of more than 0 and up to 1 frame\n";
+                return 1;
+            }
+        } else if (arg == "--denoise") {
+            denoise = true;
+        } else if (arg == "--denoise-bench" && i + 1 < argc) {
+            denoiseBenchSamples = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--serve" && i + 1 < argc) {
+            serveSocket = argv[++i];
+        } else if (arg == "--cache-size" && i + 1 < argc) {
+            sceneCacheSize = std::stoul(argv[++i]);
+            if (sceneCacheSize == 0) {
+                std::cerr << "--cache-size needs at least 1 scene\n";
+                return 1;
+            }
+        } else if (arg == "--worker" && i + 1 < argc) {
+            workerAddress = argv[++i];
+        } else if (arg == "--workers" && i + 1 < argc) {
+            std::stringstream list(argv[++i]);
+            std::string address;
+            while (std::getline(list, address, ',')) {
+                if (!address.empty()) {
+                    workerAddresses.push_back(address);
+                }
+            }
+            if (workerAddresses.empty()) {
+                std::cerr << "--workers needs a list of host:port\n";
+                return 1;
+            }
+        } else if (arg == "--heatmap") {
+            writeHeatmap = true;
+        } else if (arg == "--seed" && i + 1 < argc) {
+            fixedSeed = true;
+            seed = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg.compare(0, 2, "--") == 0) {
+            std::cerr << "Unknown option: " << arg << "\n";
+            std::cerr << "Usage: " << argv[0] << " [scene.json|scene.rtsc] [--stats-json <stats.json>] [--seed <n>] [--heatmap]"
+                      << " [--threads <n>] [--trace <trace.json>] [--integrator recursive|wavefront]"
+                      << " [--ray-sort on|off|auto] [--roulette <min depth>] [--cutoff <throughput>]"
+                      << " [--progressive <spp>] [--time-budget <ms>] [--checkpoint <file>] [--checkpoint-interval <s>]"
+                      << " [--preview-interval <passes>] [--resume <file>] [--denoise] [--denoise-bench <max spp>]"
+                      << " [--animate <frames>] [--output-dir <dir>] [--motion-blur <shutter>]"
+                      << " [--serve <socket>] [--cache-size <scenes>] [--worker <[host:]port>] [--workers <host:port,...>]\n";
+            return 1;
+        } else {
+            sceneFile = arg;
+        }
+    }
 
-    // Parse background color
-    Vec3 backgroundColor = parseBackgroundColor(config["scene"]);
+    if (progressive.timeBudgetMs > 0.0 && progressive.samples == 0) {
+        progressive.samples = std::numeric_limits<uint32_t>::max();  // as many as fit in the budget
+    }
+    if (!progressive.resumeFile.empty() && progressive.samples == 0) {
+        std::cerr << "--resume needs --progressive <spp>\n";
+        return 1;
+    }
+    if (progressive.samples > 0 && integrator == "wavefront") {
+        std::cerr << "--progressive and --time-budget need the recursive integrator\n";
+        return 1;
+    }
+    if (denoise && progressive.samples == 0) {
+        std::cerr << "--denoise needs --progressive or --time-budget\n";
+        return 1;
+    }
+    if (animation.frames > 0 && (integrator == "wavefront" || progressive.samples > 0 || denoiseBenchSamples > 0)) {
+        std::cerr << "--animate renders with the recursive integrator, without --progressive or --denoise-bench\n";
+        return 1;
+    }
+    if (denoiseBenchSamples > 0 && integrator == "wavefront") {
+        std::cerr << "--denoise-bench needs the recursive integrator\n";
+        return 1;
+    }
+    if (!animation.videoFile.empty() && animation.frames == 0) {
+        std::cerr << "--video needs --animate\n";
+        return 1;
+    }
+    if (animation.reuse && animation.frames == 0) {
+        std::cerr << "--reuse and --verify-reuse need --animate\n";
+        return 1;
+    }
+    if (!serveSocket.empty() && (animation.frames > 0 || progressive.samples > 0 || denoiseBenchSamples > 0 ||
+                                 writeHeatmap || animation.shutter > 0.0f)) {
+        std::cerr << "--serve renders single images, without --animate, --progressive, --denoise-bench, --heatmap"
+                  << " or --motion-blur\n";
+        return 1;
+    }
+    if ((!workerAddress.empty() || !workerAddresses.empty()) &&
+        (animation.frames > 0 || progressive.samples > 0 || denoiseBenchSamples > 0 || writeHeatmap ||
+         animation.shutter > 0.0f || integrator == "wavefront" || !serveSocket.empty())) {
+        std::cerr << "--worker and --workers render single images with the recursive integrator, without --animate,"
+                  << " --progressive, --denoise-bench, --heatmap, --motion-blur or --serve\n";
+        return 1;
+    }
+    if (!workerAddress.empty() && termination.enabled()) {
+        std::cerr << "--worker takes --roulette and --cutoff from the coordinator, give them to --workers\n";
+        return 1;
+    }
+    if (!workerAddress.empty() && !workerAddresses.empty()) {
+        std::cerr << "A process is either a --worker or the coordinator of --workers\n";
+        return 1;
+    }
+    if (animation.videoFile == "-") {
+        cout.rdbuf(std::cerr.rdbuf());  // stdout carries the video, the log goes to stderr
+    }
+    if (progressive.checkpointFile.empty()) {
+        progressive.checkpointFile = progressive.resumeFile;  // keep checkpointing where we resumed from
+    }
 
+    if (!traceFile.empty()) {
+#ifdef RT_TRACE
+        Trace::enable();
+#else
+        std::cerr << "Warning: tracing is compiled out, rebuild with make TRACE=1 for --trace\n";
+#endif
+    }
 
-    parseShapes(config["scene"]["shapes"], spheres, cylinders, triangles);
-    std::vector<PointLight> lights = parseLights(config["scene"]);
-  int nbounces = config.contains("nbounces") ? config["nbounces"].get<int>() : 1; // Adjust the default value as needed
+    // Render service: scenes stay loaded between jobs, see render_server.h
+    if (!serveSocket.empty()) {
+        ThreadPool pool(threads);
+        try {
+            RenderServer server(serveSocket, sceneCacheSize, loadScene,
+                                [&](const Scene& jobScene, const PinholeCamera& jobCamera, unsigned jobSeed, Vec3* jobImage) {
+                rendermode = jobScene.rendermode;
+                if (integrator == "wavefront") {
+                    WavefrontIntegrator wavefront(pool, 64 * 1024, raySort, termination);
+                    wavefront.render(jobCamera, jobScene, jobScene.nbounces, rendermode == "phong", jobImage, jobSeed);
+                } else {
+                    renderImage(pool, jobCamera, jobScene, jobScene.nbounces, jobImage, nullptr, jobSeed);
+                }
+            });
+            cout << "Serving on " << serveSocket << " with " << pool.size() << " threads, up to " << sceneCacheSize
+                 << " scenes cached" << endl;
+            std::signal(SIGINT, requestStop);
+            std::signal(SIGTERM, requestStop);
+            server.run(stopRequested);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
+        RenderStats::printSummary(cout);
+        return 0;
+    }
 
-    cout<<"nbounces: "<<nbounces<<endl;
-    rendermode = config["rendermode"];
-    cout<<"rendermode: "<<rendermode<<endl;
-    
+    // Tile worker: renders tiles of a frame for a coordinator, see distributed.h
+    if (!workerAddress.empty()) {
+        ThreadPool pool(threads);
+        try {
+            TileWorker worker(workerAddress, [&](const Scene& jobScene, const TileGrid& tiles, size_t first, size_t count,
+                                                 unsigned jobSeed, const PathTermination& jobTermination, Vec3* jobImage) {
+                rendermode = jobScene.rendermode;
+                termination = jobTermination;
+                pool.parallelFor(count, [&](size_t i) {
+                    renderTile(jobScene.cameras[0], jobScene, jobScene.nbounces, tiles, first + i, jobImage, nullptr,
+                               jobSeed);
+                });
+            });
+            cout << "Tile worker on " << workerAddress << " with " << pool.size() << " threads" << endl;
+            std::signal(SIGINT, requestStop);
+            std::signal(SIGTERM, requestStop);
+            worker.run(stopRequested);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
+        RenderStats::printSummary(cout);
+        return 0;
+    }
 
+    Scene scene;
+    try {
+        ScopedTimer timer("parse");
+        TRACE_SCOPE("parse", "io");
+        scene = loadScene(sceneFile);
+    } catch (const std::exception& e) {
+        std::cerr << "Error loading scene: " << e.what() << "\n";
+        return 1;
+    }
 
-    srand(static_cast<unsigned>(time(0))); // Seed for random number generation
+    if (scene.cameras.empty()) {
+        std::cerr << "Error: scene has no camera\n";
+        return 1;
+    }
 
+    // A still with motion blur is the first frame of the scene's keyframe animation,
+    // seen with the shutter open for the given part of a frame
+    if (animation.shutter > 0.0f && animation.frames == 0) {
+        if (scene.animated()) {
+            Scene closing;
+            KeyframeMotion(scene).applyShutter(scene, 0.0f, animation.shutter, scene, closing);
+        } else {
+            std::cerr << "Warning: nothing in the scene is keyframed, --motion-blur has nothing to blur\n";
+        }
+    }
 
-    for (int j = 0; j < height; ++j) {  // Change loop condition to start from the top
-        for (int i = 0; i < width; ++i) {
-            float u = static_cast<float>(i) / static_cast<float>(width);
-            float v = 1.0f - static_cast<float>(j) / static_cast<float>(height);
-            Ray ray = camera.generateRay(u, v);
-            Vec3 color = renderPixel(camera, spheres, cylinders, triangles, lights, nbounces, u, v, width, height,ray);
-            if (rendermode =="phong")
-            {
-            color+=backgroundColor;
-            }
-            image[j * width + i] = color;
+    // Several cameras (a list or an orbit) render a view each, see renderViews()
+    bool batchViews = scene.cameras.size() > 1;
+    if (batchViews && (animation.frames > 0 || progressive.samples > 0 || denoiseBenchSamples > 0 || writeHeatmap ||
+                       !workerAddresses.empty())) {
+        std::cerr << "Warning: the scene has " << scene.cameras.size() << " cameras, --animate, --progressive,"
+                  << " --denoise-bench, --heatmap and --workers only render the first\n";
+        batchViews = false;
+    }
+
+    // The coordinator of --workers only merges their tiles, they parse and build the
+    // scene themselves
+    bool distributed = !workerAddresses.empty();
+    std::string sceneText;
+    if (distributed) {
+        const std::string binaryExtension = ".rtsc";
+        if (sceneFile.size() >= binaryExtension.size() &&
+            sceneFile.compare(sceneFile.size() - binaryExtension.size(), binaryExtension.size(), binaryExtension) == 0) {
+            std::cerr << "Error: --workers are sent the scene as JSON, not a binary scene\n";
+            return 1;
         }
+        MappedFile file(sceneFile);
+        sceneText.assign(file.data(), file.size());
     }
 
-    ImageWriter::writePPM("output.ppm", width, height, image);
+    // Initialize camera
+    const PinholeCamera& camera = scene.cameras[0];
+    const int width = camera.width;
+    const int height = camera.height;
+
+    std::vector<Vec3> image(static_cast<size_t>(width) * height);
+    std::unique_ptr<CostHeatmap> heatmap;
+    if (writeHeatmap && integrator == "wavefront") {
+        std::cerr << "Warning: --heatmap needs the recursive integrator, no heatmap is written\n";
+    } else if (writeHeatmap && progressive.samples > 0) {
+        std::cerr << "Warning: --heatmap is not supported with --progressive, no heatmap is written\n";
+    } else if (writeHeatmap) {
+        heatmap.reset(new CostHeatmap(width, height));
+    }
+
+    // Build the acceleration structure, build temporaries go to a scratch arena
+    Arena scratch;
+    if (!distributed) {
+        ScopedTimer timer("build");
+        TRACE_SCOPE("bvh build", "build");
+        scene.buildBVH(scratch);
+        cout << "BVH: " << scene.bvh.size() << " nodes, " << scene.bvh.arenaStats().bytesInUse / 1024 << " KB" << endl;
+    }
 
-    delete[] image;
+    int nbounces = scene.nbounces;
 
+    cout<<"nbounces: "<<nbounces<<endl;
+    rendermode = scene.rendermode;
+    cout<<"rendermode: "<<rendermode<<endl;
     
 
 
-    const int numFrames = 20;  // Adjust the number of frames based on your requirements
-    
-    std::string outputDirectory = "output_images";
+    // Seed for random number generation, --seed makes renders repeatable
+    if (!fixedSeed) {
+        seed = static_cast<unsigned>(time(0));
+    }
+
+    ThreadPool pool(threads);
+    cout << "threads: " << pool.size() << endl;
+
+    {
+        ScopedTimer timer("render");
+        TRACE_SCOPE("render", "render");
+        if (distributed) {
+            try {
+                TileCoordinator coordinator(workerAddresses);
+                std::signal(SIGINT, requestStop);
+                std::signal(SIGTERM, requestStop);
+                coordinator.render(sceneText, width, height, seed, termination, image.data(), stopRequested);
+                coordinator.printSummary(cout);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+                return 1;
+            }
+        } else if (batchViews) {
+            try {
+                if (integrator == "wavefront") {
+                    // Each view fills the pool with its own ray batches, so views go one by one
+                    WavefrontIntegrator wavefront(pool, 64 * 1024, raySort, termination);
+                    mkdir(animation.outputDirectory.c_str(), 0755);
+                    for (size_t v = 0; v < scene.cameras.size(); ++v) {
+                        const PinholeCamera& view = scene.cameras[v];
+                        std::vector<Vec3> viewImage(static_cast<size_t>(view.width) * view.height);
+                        wavefront.render(view, scene, nbounces, rendermode == "phong", viewImage.data(), seed);
+                        std::string filename = animation.outputDirectory + "/view_" + std::to_string(v) + ".ppm";
+                        ImageWriter::writePPM(filename.c_str(), view.width, view.height, viewImage.data());
+                    }
+                } else {
+                    renderViews(pool, scene, nbounces, animation.outputDirectory, seed);
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+                return 1;
+            }
+            cout << "Rendered " << scene.cameras.size() << " views to " << animation.outputDirectory << "/view_<n>.ppm"
+                 << endl;
+        } else if (integrator == "wavefront") {
+            WavefrontIntegrator wavefront(pool, 64 * 1024, raySort, termination);
+            wavefront.render(camera, scene, nbounces, rendermode == "phong", image.data(), seed);
+        } else if (animation.frames > 0) {
+            try {
+                renderImagesWithMovingObjects(pool, camera, scene, nbounces, animation, seed);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+                return 1;
+            }
+        } else if (denoiseBenchSamples > 0) {
+            try {
+                runDenoiseBenchmark(pool, camera, scene, nbounces, denoiseBenchSamples, image.data(), seed);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+                return 1;
+            }
+        } else if (progressive.samples > 0) {
+            try {
+                std::unique_ptr<Denoiser> denoiser;
+                if (denoise) {
+                    denoiser.reset(new Denoiser(pool, width, height));
+                }
+                MappedFile file(sceneFile);
+                progressive.sceneHash = RenderSource::hashBytes(file.data(), file.size());
+                renderProgressive(pool, camera, scene, nbounces, image.data(), progressive, seed, denoiser.get());
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+                return 1;
+            }
+        } else {
+            renderImage(pool, camera, scene, nbounces, image.data(), heatmap.get(), seed);
+        }
+    }
+
+    // Animations and views have written their images already
+    if (animation.frames == 0 && !batchViews) {
+        ScopedTimer timer("write");
+        TRACE_SCOPE("write image", "io");
+        try {
+            ImageWriter::writePPM("output.ppm", width, height, image.data());
+            if (heatmap) {
+                heatmap->write("output_cost");
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
+    }
+
+    RenderStats::printSummary(cout);
+    if (!statsFile.empty()) {
+        try {
+            RenderStats::writeJSON(statsFile, sceneFile);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
+    }
+#ifdef RT_TRACE
+    if (!traceFile.empty()) {
+        try {
+            Trace::write(traceFile);
+            cout << "Trace written: " << traceFile << endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
+    }
+#endif
 
- // Call the function to render images with a moving object
-    //renderImagesWithMovingObjects(camera, spheres, cylinders, triangles, lights, nbounces, numFrames, outputDirectory);
-    
     return 0;
 }
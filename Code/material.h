@@ -59,6 +59,13 @@ public:
         isrefractive = json.value("isrefractive", false);
         refractiveindex = json.value("refractiveindex", 1.0f);
     }
+
+    bool operator==(const Material& other) const {
+        return ks == other.ks && kd == other.kd && ka == other.ka && specularexponent == other.specularexponent &&
+               diffusecolor == other.diffusecolor && specularcolor == other.specularcolor &&
+               isreflective == other.isreflective && reflectivity == other.reflectivity &&
+               isrefractive == other.isrefractive && refractiveindex == other.refractiveindex;
+    }
 };
 
 #endif // MATERIAL_H
@@ -0,0 +1,30 @@
+// mesh.h
+#ifndef MESH_H
+#define MESH_H
+
+#include "Vec3.h"
+#include "Triangle.h"
+#include <vector>
+#include <cstdint>
+
+// Indexed triangle mesh: a shared vertex buffer plus three vertex indices per face
+class Mesh {
+public:
+    std::vector<Vec3> vertices;
+    std::vector<uint32_t> indices;
+
+    size_t triangleCount() const {
+        return indices.size() / 3;
+    }
+
+    // Expand the indexed faces into the triangle list used by the renderer, all with
+    // the material at index material of Scene::materials
+    void appendTriangles(std::vector<Triangle>& triangles, uint32_t material) const {
+        triangles.reserve(triangles.size() + triangleCount());
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            triangles.emplace_back(vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]], material);
+        }
+    }
+};
+
+#endif // MESH_H
@@ -0,0 +1,691 @@
+// mesh_loader.h
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "mesh.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loads Wavefront OBJ and binary PLY meshes. The file is memory mapped and split
+// into chunks that are parsed on separate threads, each one writing straight into
+// its slice of the mesh vertex and index buffers.
+class MeshLoader {
+public:
+    // Pick the parser from the file extension
+    static Mesh load(const std::string& filename) {
+        std::string extension;
+        size_t dot = filename.find_last_of('.');
+        if (dot != std::string::npos) {
+            extension = filename.substr(dot);
+            std::transform(extension.begin(), extension.end(), extension.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        }
+
+        if (extension == ".obj") {
+            return loadOBJ(filename);
+        } else if (extension == ".ply") {
+            return loadPLY(filename);
+        }
+        throw std::invalid_argument("Unsupported mesh file format: " + filename);
+    }
+
+    static Mesh loadOBJ(const std::string& filename);
+    static Mesh loadPLY(const std::string& filename);
+
+    // Parse a decimal float starting at p (leading blanks are skipped) and advance p past it.
+    // Much faster than strtof since it ignores locales and never allocates.
+    static float parseFloat(const char*& p, const char* end);
+    static long long parseInt(const char*& p, const char* end);
+
+private:
+    // Files smaller than this are parsed on the calling thread only
+    static constexpr size_t minBytesPerChunk = 1 << 20;
+
+    enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Invalid };
+
+    struct PlyProperty {
+        std::string name;
+        PlyType type;
+        bool isList;
+        PlyType countType;
+    };
+
+    struct PlyElement {
+        std::string name;
+        size_t count;
+        std::vector<PlyProperty> properties;
+    };
+
+    struct ObjCounts {
+        size_t vertices = 0;
+        size_t triangles = 0;
+    };
+
+    static size_t workerCount() {
+        unsigned int n = std::thread::hardware_concurrency();
+        return n == 0 ? 1 : n;
+    }
+
+    // Run function(chunk) for every chunk, one thread per chunk
+    template <typename Function>
+    static void parallelChunks(size_t numChunks, const Function& function) {
+        std::vector<std::thread> workers;
+        for (size_t chunk = 1; chunk < numChunks; ++chunk) {
+            workers.emplace_back([&function, chunk]() { function(chunk); });
+        }
+        if (numChunks > 0) {
+            function(0);
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    static bool isBlank(char c) {
+        return c == ' ' || c == '\t';
+    }
+
+    static bool isDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    static size_t bytesLeft(const char* p, const char* end) {
+        return p < end ? static_cast<size_t>(end - p) : 0;
+    }
+
+    static const char* skipBlanks(const char* p, const char* end) {
+        while (p < end && isBlank(*p)) ++p;
+        return p;
+    }
+
+    static const char* findLineEnd(const char* p, const char* end) {
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        return newline != nullptr ? newline : end;
+    }
+
+    // Line end ignoring a trailing comment or carriage return
+    static const char* findContentEnd(const char* p, const char* lineEnd) {
+        const char* q = p;
+        while (q < lineEnd && *q != '#' && *q != '\r') ++q;
+        return q;
+    }
+
+    static size_t countFaceVertices(const char* p, const char* end);
+    static ObjCounts countOBJ(const char* begin, const char* end);
+    static bool parseOBJ(const char* begin, const char* end, size_t vertexBase, size_t totalVertices,
+                         Vec3* outVertices, uint32_t* outIndices);
+
+    static PlyType plyTypeFromName(const std::string& name);
+    static size_t plyTypeSize(PlyType type);
+    static double readPlyValue(const char* p, PlyType type, bool swapBytes);
+};
+
+inline float MeshLoader::parseFloat(const char*& p, const char* end) {
+    static const double powersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    p = skipBlanks(p, end);
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    // Accumulate up to 19 significant digits in an integer, the rest only moves the exponent
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    while (p < end && isDigit(*p)) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+            if (mantissa != 0) ++digits;
+        } else {
+            ++exponent;
+        }
+        ++p;
+    }
+
+    if (p < end && *p == '.') {
+        ++p;
+        while (p < end && isDigit(*p)) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                if (mantissa != 0) ++digits;
+                --exponent;
+            }
+            ++p;
+        }
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negativeExponent = (*p == '-');
+            ++p;
+        }
+        int value = 0;
+        while (p < end && isDigit(*p)) {
+            if (value < 10000) value = value * 10 + (*p - '0');
+            ++p;
+        }
+        exponent += negativeExponent ? -value : value;
+    }
+
+    double result = static_cast<double>(mantissa);
+    if (mantissa != 0 && exponent != 0) {
+        int magnitude = exponent < 0 ? -exponent : exponent;
+        double scale = magnitude <= 22 ? powersOfTen[magnitude] : std::pow(10.0, magnitude);
+        result = exponent < 0 ? result / scale : result * scale;
+    }
+
+    return static_cast<float>(negative ? -result : result);
+}
+
+inline long long MeshLoader::parseInt(const char*& p, const char* end) {
+    p = skipBlanks(p, end);
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    long long value = 0;
+    while (p < end && isDigit(*p)) {
+        value = value * 10 + (*p - '0');
+        ++p;
+    }
+    return negative ? -value : value;
+}
+
+inline size_t MeshLoader::countFaceVertices(const char* p, const char* end) {
+    size_t count = 0;
+    while (true) {
+        p = skipBlanks(p, end);
+        if (p >= end) break;
+        ++count;
+        while (p < end && !isBlank(*p)) ++p;
+    }
+    return count;
+}
+
+// First pass over a chunk: only count vertices and (fan triangulated) faces so that
+// the final buffers can be sized and every chunk knows where its output goes
+inline MeshLoader::ObjCounts MeshLoader::countOBJ(const char* begin, const char* end) {
+    ObjCounts counts;
+    const char* p = begin;
+    while (p < end) {
+        const char* lineEnd = findLineEnd(p, end);
+        const char* q = skipBlanks(p, lineEnd);
+
+        if (lineEnd - q >= 2 && isBlank(q[1])) {
+            if (q[0] == 'v') {
+                ++counts.vertices;
+            } else if (q[0] == 'f') {
+                size_t n = countFaceVertices(q + 2, findContentEnd(q + 2, lineEnd));
+                if (n >= 3) counts.triangles += n - 2;
+            }
+        }
+        p = lineEnd + 1;
+    }
+    return counts;
+}
+
+// Second pass: parse the chunk into the preallocated slices. Returns false if a face
+// references a vertex that does not exist.
+inline bool MeshLoader::parseOBJ(const char* begin, const char* end, size_t vertexBase, size_t totalVertices,
+                                 Vec3* outVertices, uint32_t* outIndices) {
+    bool valid = true;
+    size_t localVertices = 0;
+    const char* p = begin;
+
+    while (p < end) {
+        const char* lineEnd = findLineEnd(p, end);
+        const char* q = skipBlanks(p, lineEnd);
+
+        if (lineEnd - q >= 2 && isBlank(q[1])) {
+            if (q[0] == 'v') {
+                const char* contentEnd = findContentEnd(q + 2, lineEnd);
+                const char* cursor = q + 2;
+                float x = parseFloat(cursor, contentEnd);
+                float y = parseFloat(cursor, contentEnd);
+                float z = parseFloat(cursor, contentEnd);
+                outVertices[localVertices++] = Vec3(x, y, z);
+            } else if (q[0] == 'f') {
+                const char* contentEnd = findContentEnd(q + 2, lineEnd);
+                const char* cursor = q + 2;
+                size_t n = 0;
+                uint32_t first = 0, previous = 0;
+
+                while (true) {
+                    cursor = skipBlanks(cursor, contentEnd);
+                    if (cursor >= contentEnd) break;
+
+                    // Only the position index is used, "v/vt/vn" and "v//vn" skip the rest
+                    long long index = parseInt(cursor, contentEnd);
+                    while (cursor < contentEnd && !isBlank(*cursor)) ++cursor;
+
+                    // Negative indices are relative to the last vertex seen so far
+                    long long resolved = index > 0 ? index - 1
+                                                   : static_cast<long long>(vertexBase + localVertices) + index;
+                    if (index == 0 || resolved < 0 || resolved >= static_cast<long long>(totalVertices)) {
+                        valid = false;
+                        resolved = 0;
+                    }
+
+                    uint32_t current = static_cast<uint32_t>(resolved);
+                    if (n == 0) {
+                        first = current;
+                    } else if (n >= 2) {
+                        outIndices[0] = first;
+                        outIndices[1] = previous;
+                        outIndices[2] = current;
+                        outIndices += 3;
+                    }
+                    previous = current;
+                    ++n;
+                }
+            }
+        }
+        p = lineEnd + 1;
+    }
+    return valid;
+}
+
+inline Mesh MeshLoader::loadOBJ(const std::string& filename) {
+    MappedFile file(filename);
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+
+    // Split the file into chunks that start right after a newline
+    size_t numChunks = std::max<size_t>(1, std::min(workerCount(), file.size() / minBytesPerChunk));
+    std::vector<const char*> bounds(numChunks + 1, end);
+    bounds[0] = begin;
+    for (size_t c = 1; c < numChunks; ++c) {
+        const char* p = std::max(begin + file.size() * c / numChunks, bounds[c - 1]);
+        const char* lineEnd = findLineEnd(p, end);
+        bounds[c] = lineEnd < end ? lineEnd + 1 : end;
+    }
+
+    std::vector<ObjCounts> counts(numChunks);
+    parallelChunks(numChunks, [&](size_t c) {
+        counts[c] = countOBJ(bounds[c], bounds[c + 1]);
+    });
+
+    // Prefix sums give each chunk its offset into the shared buffers
+    std::vector<size_t> vertexBase(numChunks), triangleBase(numChunks);
+    size_t totalVertices = 0, totalTriangles = 0;
+    for (size_t c = 0; c < numChunks; ++c) {
+        vertexBase[c] = totalVertices;
+        triangleBase[c] = totalTriangles;
+        totalVertices += counts[c].vertices;
+        totalTriangles += counts[c].triangles;
+    }
+
+    if (totalVertices > UINT32_MAX) {
+        throw std::runtime_error("Too many vertices in OBJ file: " + filename);
+    }
+
+    Mesh mesh;
+    mesh.vertices.resize(totalVertices);
+    mesh.indices.resize(totalTriangles * 3);
+
+    std::atomic<bool> valid(true);
+    parallelChunks(numChunks, [&](size_t c) {
+        if (!parseOBJ(bounds[c], bounds[c + 1], vertexBase[c], totalVertices,
+                      mesh.vertices.data() + vertexBase[c], mesh.indices.data() + triangleBase[c] * 3)) {
+            valid = false;
+        }
+    });
+
+    if (!valid) {
+        throw std::runtime_error("Face references a missing vertex in OBJ file: " + filename);
+    }
+    return mesh;
+}
+
+inline MeshLoader::PlyType MeshLoader::plyTypeFromName(const std::string& name) {
+    if (name == "char" || name == "int8") return PlyType::Int8;
+    if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+    if (name == "short" || name == "int16") return PlyType::Int16;
+    if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+    if (name == "int" || name == "int32") return PlyType::Int32;
+    if (name == "uint" || name == "uint32") return PlyType::UInt32;
+    if (name == "float" || name == "float32") return PlyType::Float32;
+    if (name == "double" || name == "float64") return PlyType::Float64;
+    return PlyType::Invalid;
+}
+
+inline size_t MeshLoader::plyTypeSize(PlyType type) {
+    switch (type) {
+        case PlyType::Int8: case PlyType::UInt8: return 1;
+        case PlyType::Int16: case PlyType::UInt16: return 2;
+        case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+        case PlyType::Float64: return 8;
+        default: return 0;
+    }
+}
+
+inline double MeshLoader::readPlyValue(const char* p, PlyType type, bool swapBytes) {
+    unsigned char bytes[8];
+    size_t size = plyTypeSize(type);
+    std::memcpy(bytes, p, size);
+    if (swapBytes) {
+        std::reverse(bytes, bytes + size);
+    }
+
+    switch (type) {
+        case PlyType::Int8: { int8_t v; std::memcpy(&v, bytes, 1); return v; }
+        case PlyType::UInt8: { uint8_t v; std::memcpy(&v, bytes, 1); return v; }
+        case PlyType::Int16: { int16_t v; std::memcpy(&v, bytes, 2); return v; }
+        case PlyType::UInt16: { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+        case PlyType::Int32: { int32_t v; std::memcpy(&v, bytes, 4); return v; }
+        case PlyType::UInt32: { uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+        case PlyType::Float32: { float v; std::memcpy(&v, bytes, 4); return v; }
+        case PlyType::Float64: { double v; std::memcpy(&v, bytes, 8); return v; }
+        default: return 0.0;
+    }
+}
+
+inline Mesh MeshLoader::loadPLY(const std::string& filename) {
+    MappedFile file(filename);
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+
+    // Parse the ASCII header
+    if (file.size() < 4 || std::strncmp(begin, "ply", 3) != 0) {
+        throw std::runtime_error("Not a PLY file: " + filename);
+    }
+
+    std::vector<PlyElement> elements;
+    bool bigEndian = false;
+    bool sawEndHeader = false;
+    const char* p = begin;
+
+    while (p < end && !sawEndHeader) {
+        const char* lineEnd = findLineEnd(p, end);
+        std::string line(p, findContentEnd(p, lineEnd) - p);
+        p = lineEnd + 1;
+
+        std::vector<std::string> tokens;
+        size_t pos = 0;
+        while (pos < line.size()) {
+            while (pos < line.size() && isBlank(line[pos])) ++pos;
+            size_t start = pos;
+            while (pos < line.size() && !isBlank(line[pos])) ++pos;
+            if (pos > start) tokens.push_back(line.substr(start, pos - start));
+        }
+        if (tokens.empty()) continue;
+
+        if (tokens[0] == "format" && tokens.size() >= 2) {
+            if (tokens[1] == "binary_little_endian") {
+                bigEndian = false;
+            } else if (tokens[1] == "binary_big_endian") {
+                bigEndian = true;
+            } else {
+                throw std::runtime_error("Only binary PLY files are supported: " + filename);
+            }
+        } else if (tokens[0] == "element" && tokens.size() >= 3) {
+            elements.push_back({tokens[1], static_cast<size_t>(std::stoull(tokens[2])), {}});
+        } else if (tokens[0] == "property" && !elements.empty()) {
+            PlyProperty property;
+            if (tokens.size() >= 5 && tokens[1] == "list") {
+                property = {tokens[4], plyTypeFromName(tokens[3]), true, plyTypeFromName(tokens[2])};
+            } else if (tokens.size() >= 3) {
+                property = {tokens[2], plyTypeFromName(tokens[1]), false, PlyType::Invalid};
+            } else {
+                throw std::runtime_error("Malformed PLY property in: " + filename);
+            }
+            if (property.type == PlyType::Invalid || (property.isList && property.countType == PlyType::Invalid)) {
+                throw std::runtime_error("Unknown PLY property type in: " + filename);
+            }
+            elements.back().properties.push_back(property);
+        } else if (tokens[0] == "end_header") {
+            sawEndHeader = true;
+        }
+    }
+
+    if (!sawEndHeader) {
+        throw std::runtime_error("Missing end_header in PLY file: " + filename);
+    }
+
+    // The host is assumed little endian, as on every platform we build for
+    const bool swapBytes = bigEndian;
+    const char* body = p;
+    Mesh mesh;
+    bool truncated = false;
+
+    // Face indices are checked against the header's vertex count as they are read, a
+    // negative or too large value cast to uint32_t would be undefined
+    size_t vertexCount = 0;
+    for (const auto& element : elements) {
+        if (element.name == "vertex") {
+            vertexCount = element.count;
+        }
+    }
+    auto validIndex = [vertexCount](double index) {
+        return index >= 0.0 && index < static_cast<double>(vertexCount);
+    };
+
+    for (const auto& element : elements) {
+        // Byte layout of the fixed size part of the element
+        size_t fixedStride = 0;
+        bool hasList = false;
+        for (const auto& property : element.properties) {
+            if (property.isList) {
+                hasList = true;
+            } else {
+                fixedStride += plyTypeSize(property.type);
+            }
+        }
+
+        if (element.name == "vertex") {
+            if (hasList) {
+                throw std::runtime_error("List properties on PLY vertices are not supported: " + filename);
+            }
+
+            size_t offsets[3] = {0, 0, 0};
+            PlyType types[3] = {PlyType::Invalid, PlyType::Invalid, PlyType::Invalid};
+            const char* axisNames[3] = {"x", "y", "z"};
+            size_t offset = 0;
+            for (const auto& property : element.properties) {
+                for (int axis = 0; axis < 3; ++axis) {
+                    if (property.name == axisNames[axis]) {
+                        offsets[axis] = offset;
+                        types[axis] = property.type;
+                    }
+                }
+                offset += plyTypeSize(property.type);
+            }
+            if (types[0] == PlyType::Invalid || types[1] == PlyType::Invalid || types[2] == PlyType::Invalid) {
+                throw std::runtime_error("PLY vertices need x, y and z properties: " + filename);
+            }
+
+            if (bytesLeft(body, end) < element.count * fixedStride) {
+                truncated = true;
+                break;
+            }
+
+            mesh.vertices.resize(element.count);
+            const bool packedFloats = !swapBytes && types[0] == PlyType::Float32 &&
+                                      types[1] == PlyType::Float32 && types[2] == PlyType::Float32;
+            size_t numChunks = std::max<size_t>(1, std::min(workerCount(), element.count * fixedStride / minBytesPerChunk));
+
+            parallelChunks(numChunks, [&](size_t c) {
+                size_t first = element.count * c / numChunks;
+                size_t last = element.count * (c + 1) / numChunks;
+                for (size_t i = first; i < last; ++i) {
+                    const char* record = body + i * fixedStride;
+                    float xyz[3];
+                    for (int axis = 0; axis < 3; ++axis) {
+                        if (packedFloats) {
+                            std::memcpy(&xyz[axis], record + offsets[axis], sizeof(float));
+                        } else {
+                            xyz[axis] = static_cast<float>(readPlyValue(record + offsets[axis], types[axis], swapBytes));
+                        }
+                    }
+                    mesh.vertices[i] = Vec3(xyz[0], xyz[1], xyz[2]);
+                }
+            });
+            body += element.count * fixedStride;
+        } else if (element.name == "face") {
+            // Locate the index list, every other property is skipped
+            const PlyProperty* indexList = nullptr;
+            size_t bytesBefore = 0;
+            bool otherLists = false;
+            for (const auto& property : element.properties) {
+                if (property.isList && (property.name == "vertex_indices" || property.name == "vertex_index")) {
+                    indexList = &property;
+                } else if (property.isList) {
+                    otherLists = true;
+                } else if (indexList == nullptr) {
+                    bytesBefore += plyTypeSize(property.type);
+                }
+            }
+            if (indexList == nullptr) {
+                throw std::runtime_error("PLY faces need a vertex_indices list: " + filename);
+            }
+
+            const size_t countSize = plyTypeSize(indexList->countType);
+            const size_t indexSize = plyTypeSize(indexList->type);
+
+            // Fast path: nearly every PLY in practice is all triangles, which gives a fixed
+            // record size and lets the faces be decoded in parallel. Any other face count
+            // falls back to the sequential reader below.
+            bool allTriangles = false;
+            const size_t triangleStride = fixedStride + countSize + 3 * indexSize;
+            if (!otherLists && bytesLeft(body, end) >= element.count * triangleStride) {
+                mesh.indices.resize(element.count * 3);
+                size_t numChunks = std::max<size_t>(1, std::min(workerCount(), element.count * triangleStride / minBytesPerChunk));
+                std::atomic<bool> fixedLayout(true);
+                std::atomic<bool> indicesValid(true);
+
+                parallelChunks(numChunks, [&](size_t c) {
+                    size_t first = element.count * c / numChunks;
+                    size_t last = element.count * (c + 1) / numChunks;
+                    for (size_t i = first; i < last && fixedLayout; ++i) {
+                        const char* record = body + i * triangleStride + bytesBefore;
+                        if (readPlyValue(record, indexList->countType, swapBytes) != 3.0) {
+                            fixedLayout = false;
+                            break;
+                        }
+                        record += countSize;
+                        for (int k = 0; k < 3; ++k) {
+                            double index = readPlyValue(record + k * indexSize, indexList->type, swapBytes);
+                            if (!validIndex(index)) {
+                                indicesValid = false;
+                                index = 0.0;
+                            }
+                            mesh.indices[i * 3 + k] = static_cast<uint32_t>(index);
+                        }
+                    }
+                });
+
+                allTriangles = fixedLayout;
+                if (allTriangles && !indicesValid) {
+                    throw std::runtime_error("Face references a missing vertex in PLY file: " + filename);
+                }
+                if (allTriangles) {
+                    body += element.count * triangleStride;
+                } else {
+                    mesh.indices.clear();
+                }
+            }
+
+            if (!allTriangles) {
+                mesh.indices.reserve(element.count * 3);
+                std::vector<uint32_t> polygon;
+                for (size_t i = 0; i < element.count && !truncated; ++i) {
+                    for (const auto& property : element.properties) {
+                        if (!property.isList) {
+                            body += plyTypeSize(property.type);
+                            continue;
+                        }
+
+                        size_t propertyCountSize = plyTypeSize(property.countType);
+                        size_t itemSize = plyTypeSize(property.type);
+                        if (bytesLeft(body, end) < propertyCountSize) {
+                            truncated = true;
+                            break;
+                        }
+                        size_t n = static_cast<size_t>(readPlyValue(body, property.countType, swapBytes));
+                        body += propertyCountSize;
+                        if (bytesLeft(body, end) < n * itemSize) {
+                            truncated = true;
+                            break;
+                        }
+
+                        if (&property == indexList) {
+                            polygon.clear();
+                            for (size_t k = 0; k < n; ++k) {
+                                double index = readPlyValue(body + k * itemSize, property.type, swapBytes);
+                                if (!validIndex(index)) {
+                                    throw std::runtime_error("Face references a missing vertex in PLY file: " + filename);
+                                }
+                                polygon.push_back(static_cast<uint32_t>(index));
+                            }
+                            // Fan triangulation for quads and larger polygons
+                            for (size_t k = 2; k < polygon.size(); ++k) {
+                                mesh.indices.push_back(polygon[0]);
+                                mesh.indices.push_back(polygon[k - 1]);
+                                mesh.indices.push_back(polygon[k]);
+                            }
+                        }
+                        body += n * itemSize;
+                    }
+                }
+            }
+        } else {
+            // Skip elements we do not use (edges, materials, ...)
+            if (!hasList) {
+                body += std::min(element.count * fixedStride, bytesLeft(body, end));
+                continue;
+            }
+            for (size_t i = 0; i < element.count && !truncated; ++i) {
+                for (const auto& property : element.properties) {
+                    if (!property.isList) {
+                        body += plyTypeSize(property.type);
+                        continue;
+                    }
+                    if (bytesLeft(body, end) < plyTypeSize(property.countType)) {
+                        truncated = true;
+                        break;
+                    }
+                    size_t n = static_cast<size_t>(readPlyValue(body, property.countType, swapBytes));
+                    body += plyTypeSize(property.countType) + n * plyTypeSize(property.type);
+                }
+            }
+        }
+
+        if (truncated || body > end) {
+            truncated = true;
+            break;
+        }
+    }
+
+    if (truncated) {
+        throw std::runtime_error("Unexpected end of data in PLY file: " + filename);
+    }
+
+    for (uint32_t index : mesh.indices) {
+        if (index >= mesh.vertices.size()) {
+            throw std::runtime_error("Face references a missing vertex in PLY file: " + filename);
+        }
+    }
+    return mesh;
+}
+
+#endif // MESH_LOADER_H
@@ -0,0 +1,118 @@
+// optics.h
+#ifndef OPTICS_H
+#define OPTICS_H
+
+#include <algorithm>
+#include <cmath>
+#include "Ray.h"
+#include "Vec3.h"
+#include "material.h"
+
+// Shared by the recursive and the wavefront integrator
+
+inline Vec3 reinhardToneMapping(const Vec3& color, float exposure) {
+    float L_w = 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;  // Luminance
+
+    // Tone mapping formula
+    Vec3 mappedColor = color * (exposure / (exposure + L_w));
+
+    // Optionally, you can perform gamma correction for display
+    float gamma = 2.2f;
+    mappedColor.x = std::pow(mappedColor.x, 1.0f / gamma);
+    mappedColor.y = std::pow(mappedColor.y, 1.0f / gamma);
+    mappedColor.z = std::pow(mappedColor.z, 1.0f / gamma);
+
+    return mappedColor;
+}
+
+inline Vec3 reflect(const Vec3& incident, const Vec3& normal) {
+    return incident - 2.0f * Vec3::dot(incident, normal) * normal;
+}
+
+// Function to compute refraction direction (Snell's Law)
+inline Vec3 refract(const Vec3& incident, const Vec3& normal, float refractiveIndexRatio) {
+    float cos_theta = std::min(Vec3::dot(-incident, normal), 1.0f);
+    Vec3 perpendicular = refractiveIndexRatio * (incident + cos_theta * normal);
+    Vec3 parallel = -std::sqrt(std::abs(1.0f - perpendicular.length_squared())) * normal;
+    return perpendicular + parallel;
+}
+
+// Schlick's approximation of the Fresnel reflectance, cosine taken on either side
+inline float schlickFresnel(float cosine, float refractiveIndex) {
+    float r0 = (1.0f - refractiveIndex) / (1.0f + refractiveIndex);
+    r0 = r0 * r0;
+    float c = 1.0f - std::min(std::abs(cosine), 1.0f);
+    return r0 + (1.0f - r0) * c * c * c * c * c;
+}
+
+// Picks the one ray a path continues with after shading a hit, u is uniform in [0, 1).
+// A reflective surface gives the reflected ray with weight reflectivity, a refractive one
+// the refracted ray with weight 1 - reflectivity, like the old recursion. When a material
+// is both, one of the two is picked with probability following the Fresnel reflectance of
+// the branch weights, and the weight is divided by that probability, so the expected
+// colour is still the sum of both branches while a path costs one ray per bounce.
+// Returns false when the path ends here.
+inline bool continuePath(const Ray& ray, const Vec3& hit_point, const Vec3& normal, const Material& material,
+                         float u, Ray& next, float& weight, bool& reflected) {
+    bool canReflect = material.isreflective && material.reflectivity > 0.0f;
+    bool canRefract = material.isrefractive && material.refractiveindex > 0.0f;
+    if (!canReflect && !canRefract) {
+        return false;
+    }
+
+    float reflectProbability = canReflect ? 1.0f : 0.0f;
+    if (canReflect && canRefract) {
+        float fresnel = schlickFresnel(Vec3::dot(ray.direction, normal), material.refractiveindex);
+        float reflectImportance = material.reflectivity * fresnel;
+        float refractImportance = (1.0f - material.reflectivity) * (1.0f - fresnel);
+        reflectProbability = reflectImportance + refractImportance > 0.0f
+                                 ? reflectImportance / (reflectImportance + refractImportance)
+                                 : 0.5f;
+        // Keep both branches reachable so the weights stay bounded
+        reflectProbability = std::min(std::max(reflectProbability, 0.05f), 0.95f);
+    }
+
+    reflected = u < reflectProbability;
+    if (reflected) {
+        next = Ray(hit_point + normal * 0.01f, reflect(ray.direction, normal).normalized(), ray.time);
+        weight = material.reflectivity / reflectProbability;
+    } else {
+        next = Ray(hit_point - normal * 0.001f, refract(ray.direction, normal, 1.0f / material.refractiveindex).normalized(),
+                   ray.time);
+        weight = (1.0f - material.reflectivity) / (1.0f - reflectProbability);
+    }
+    return true;
+}
+
+// When to stop a path before its bounces run out, both tests are off by default.
+// Russian roulette keeps the image unbiased: a path survives with probability equal to
+// its largest throughput channel and is scaled up by the inverse when it does. The
+// cutoff simply drops paths whose throughput fell below it, which darkens the image by
+// at most that fraction of what the dropped paths would still have gathered.
+struct PathTermination {
+    int rouletteDepth = -1;  // roulette once a path has this many hits, < 0 disables it
+    float cutoff = 0.0f;     // throughput below which a path stops, 0 disables it
+
+    bool enabled() const {
+        return rouletteDepth >= 0 || cutoff > 0.0f;
+    }
+
+    // Whether a path with `hits` hits so far goes on, u is uniform in [0, 1). Scales
+    // throughput when roulette lets the path live.
+    bool survives(int hits, Vec3& throughput, float u) const {
+        float largest = std::max(throughput.x, std::max(throughput.y, throughput.z));
+        if (largest < cutoff) {
+            return false;
+        }
+        if (rouletteDepth >= 0 && hits >= rouletteDepth) {
+            float probability = std::min(largest, 1.0f);
+            if (u >= probability) {
+                return false;
+            }
+            throughput /= probability;
+        }
+        return true;
+    }
+};
+
+#endif // OPTICS_H
@@ -58,10 +58,20 @@ public:
         static std::mt19937 generator;
         return distribution(generator);
     }
+    // Lens samples come from one engine per thread, seeded from random_device unless
+    // seed() pins it down for reproducible renders
+    static std::default_random_engine& lensGenerator() {
+        thread_local std::default_random_engine generator(std::random_device{}());
+        return generator;
+    }
+
+    static void seed(unsigned value) {
+        lensGenerator().seed(value);
+    }
+
 Ray generateRay(float u, float v) const {
         // Generate a random point on the aperture
-        std::random_device rd;
-        std::default_random_engine generator(rd());
+        std::default_random_engine& generator = lensGenerator();
         std::uniform_real_distribution<float> distribution(-aperture / 2.0f, aperture / 2.0f);
         float lensU = distribution(generator);
         float lensV = distribution(generator);
@@ -0,0 +1,220 @@
+// progressive.h
+//
+// Sample accumulation for progressive rendering (--progressive, --time-budget). Every
+// pass adds one path per pixel to a float buffer, the image is the tone mapped mean, so
+// it can be written at any point and only gets less noisy. A pass that was cut short
+// leaves some pixels with a sample less, which is why the counts are kept per pixel.
+//
+// A checkpoint stores the buffer together with everything needed to carry on exactly
+// where the render stopped. The random engines are reseeded from the base seed, the
+// pass and the tile (see passSeed()), so the base seed and the number of passes
+// started are the whole random state.
+//
+// Checkpoint layout (little endian):
+//
+//   CheckpointHeader         magic "RTCK", version, width, height, seed, passes, the
+//                            scene and camera hashes, nbounces, rendermode
+//   float[3 * width*height]  summed radiance per pixel, row by row
+//   uint32[width*height]     samples per pixel
+//
+// Checkpoints are written to <file>.tmp and renamed over <file>, so a render killed
+// while writing leaves the previous checkpoint intact.
+//
+// The header also records what the samples were rendered from (RenderSource), a resume
+// from another scene, camera or bounce count would average two different images.
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Vec3.h"
+#include "optics.h"
+#include "pinhole_camera.h"
+
+struct CheckpointHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t seed;
+    uint32_t passes;
+    uint64_t sceneHash;
+    uint64_t cameraHash;
+    uint32_t nbounces;
+    char rendermode[16];  // zero padded
+};
+
+// What the samples of an accumulation were rendered from
+struct RenderSource {
+    uint64_t sceneHash = 0;   // bytes of the scene file
+    uint64_t cameraHash = 0;  // see hashCamera()
+    uint32_t nbounces = 0;
+    std::string rendermode;
+
+    // FNV-1a, continuing from hash
+    static uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // The fields a scene sets, the rest is derived from them
+    static uint64_t hashCamera(const PinholeCamera& camera) {
+        const float values[] = {camera.position.x, camera.position.y, camera.position.z,
+                                camera.lookAt.x,   camera.lookAt.y,   camera.lookAt.z,
+                                camera.upVector.x, camera.upVector.y, camera.upVector.z,
+                                camera.fov,        static_cast<float>(camera.exposure), camera.aperture};
+        return hashBytes(values, sizeof(values));
+    }
+
+    // Empty when both match, otherwise what differs
+    std::string difference(const RenderSource& other) const {
+        if (sceneHash != other.sceneHash) {
+            return "the scene file has changed";
+        }
+        if (cameraHash != other.cameraHash) {
+            return "the camera has changed";
+        }
+        if (nbounces != other.nbounces) {
+            return "nbounces was " + std::to_string(nbounces) + ", now " + std::to_string(other.nbounces);
+        }
+        if (rendermode != other.rendermode) {
+            return "rendermode was " + rendermode + ", now " + other.rendermode;
+        }
+        return "";
+    }
+};
+
+class Accumulation {
+public:
+    static const uint32_t checkpointVersion = 2;
+
+    Accumulation(int width, int height, unsigned seed)
+        : width(width), height(height), seed(seed), passes(0),
+          sum(static_cast<size_t>(width) * height, Vec3(0.0f, 0.0f, 0.0f)),
+          samples(static_cast<size_t>(width) * height, 0) {}
+
+    // Not synchronised, callers give each thread its own pixels
+    void add(size_t pixel, const Vec3& radiance) {
+        sum[pixel] += radiance;
+        ++samples[pixel];
+    }
+
+    // Tone mapped mean of a pixel, black while it has no samples
+    Vec3 resolve(size_t pixel) const {
+        if (samples[pixel] == 0) {
+            return Vec3(0.0f, 0.0f, 0.0f);
+        }
+        return reinhardToneMapping(sum[pixel] / static_cast<float>(samples[pixel]), 1.0f);
+    }
+
+    // Fewest, mean and most samples over all pixels
+    void sampleRange(uint32_t& fewest, double& mean, uint32_t& most) const {
+        fewest = samples.empty() ? 0 : samples[0];
+        most = fewest;
+        uint64_t total = 0;
+        for (uint32_t count : samples) {
+            fewest = std::min(fewest, count);
+            most = std::max(most, count);
+            total += count;
+        }
+        mean = samples.empty() ? 0.0 : static_cast<double>(total) / samples.size();
+    }
+
+    // Base seed of a pass, tiles derive theirs from it with TileGrid::seed()
+    static unsigned passSeed(unsigned seed, uint32_t pass) {
+        return seed ^ (pass * 0x85EBCA6Bu);
+    }
+
+    void writeCheckpoint(const std::string& filename) const {
+        std::string temporary = filename + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary);
+            if (!file.is_open()) {
+                throw std::runtime_error("Failed to open checkpoint for writing: " + temporary);
+            }
+
+            CheckpointHeader header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, "RTCK", 4);
+            header.version = checkpointVersion;
+            header.width = static_cast<uint32_t>(width);
+            header.height = static_cast<uint32_t>(height);
+            header.seed = seed;
+            header.passes = passes;
+            header.sceneHash = source.sceneHash;
+            header.cameraHash = source.cameraHash;
+            header.nbounces = source.nbounces;
+            std::strncpy(header.rendermode, source.rendermode.c_str(), sizeof(header.rendermode) - 1);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+            std::vector<float> values(sum.size() * 3);
+            for (size_t i = 0; i < sum.size(); ++i) {
+                values[3 * i] = sum[i].x;
+                values[3 * i + 1] = sum[i].y;
+                values[3 * i + 2] = sum[i].z;
+            }
+            file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float));
+            file.write(reinterpret_cast<const char*>(samples.data()), samples.size() * sizeof(uint32_t));
+
+            if (!file) {
+                throw std::runtime_error("Failed to write checkpoint: " + temporary);
+            }
+        }
+        if (std::rename(temporary.c_str(), filename.c_str()) != 0) {
+            throw std::runtime_error("Failed to replace checkpoint: " + filename);
+        }
+    }
+
+    static Accumulation readCheckpoint(const std::string& filename) {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open checkpoint: " + filename);
+        }
+
+        CheckpointHeader header;
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, "RTCK", 4) != 0) {
+            throw std::runtime_error("Not a checkpoint file: " + filename);
+        }
+        if (header.version != checkpointVersion) {
+            throw std::runtime_error("Unsupported checkpoint version in: " + filename);
+        }
+
+        Accumulation accumulation(static_cast<int>(header.width), static_cast<int>(header.height), header.seed);
+        accumulation.passes = header.passes;
+        accumulation.source.sceneHash = header.sceneHash;
+        accumulation.source.cameraHash = header.cameraHash;
+        accumulation.source.nbounces = header.nbounces;
+        accumulation.source.rendermode = std::string(header.rendermode, strnlen(header.rendermode, sizeof(header.rendermode)));
+        std::vector<float> values(accumulation.sum.size() * 3);
+        file.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(float));
+        file.read(reinterpret_cast<char*>(accumulation.samples.data()), accumulation.samples.size() * sizeof(uint32_t));
+        if (!file) {
+            throw std::runtime_error("Truncated checkpoint: " + filename);
+        }
+        for (size_t i = 0; i < accumulation.sum.size(); ++i) {
+            accumulation.sum[i] = Vec3(values[3 * i], values[3 * i + 1], values[3 * i + 2]);
+        }
+        return accumulation;
+    }
+
+    int width;
+    int height;
+    unsigned seed;
+    uint32_t passes;  // passes started, the seeds of later passes don't overlap them
+    RenderSource source;
+
+private:
+    std::vector<Vec3> sum;
+    std::vector<uint32_t> samples;
+};
+
+#endif // PROGRESSIVE_H
@@ -10,8 +10,9 @@ class Ray {
 public:
     Vec3 origin;
     Vec3 direction;
+    float time;  // when in the shutter interval [0, 1] the ray is traced, for motion blur
 
-    Ray(const Vec3& origin, const Vec3& direction) : origin(origin), direction(direction) {}
+    Ray(const Vec3& origin, const Vec3& direction, float time = 0.0f) : origin(origin), direction(direction), time(time) {}
 
     Vec3 at(float t) const {
     return origin + t * direction;
@@ -0,0 +1,466 @@
+// render_server.h
+//
+// Long running render service (--serve <socket>), so a client that renders the same
+// scene over and over pays for parsing and the BVH build once. Clients connect to a Unix
+// domain socket and send jobs, one JSON object per line:
+//
+//   {"scene": "scene_phong.json"}                                  a scene file on the server
+//   {"sceneJson": {...}, "camera": {"position": [0, 1, -2], "width": 320}, "seed": 7}
+//   {"sceneHash": "...", "edits": [{"op": "light", "index": 0, "position": [1, 2, 0]}]}
+//
+// "view" picks one of the scene's cameras, the first by default, and "camera" overrides
+// its fields (position, lookAt, upVector, fov, exposure, width, height, aperture). "seed"
+// defaults to 0. The reply is one JSON line
+//
+//   {"ok": true, "width": 320, "height": 200, "bytes": 192015, "cached": true, "hash": "...",
+//    "loadMs": 0.0, "buildMs": 0.0, "renderMs": 41.7}
+//
+// followed by that many bytes of binary PPM (P6), or {"ok": false, "error": "..."} if the
+// job failed. "render": false leaves out the image ("bytes" is 0). A connection can send
+// any number of jobs. {"command": "shutdown"} stops the server, as do SIGINT and SIGTERM.
+//
+// Parsed scenes are kept together with their BVH, keyed by a hash of the scene text (the
+// file's bytes or the serialised "sceneJson"), so a scene seen before renders from any
+// camera without parsing or building anything. Past cacheSize scenes the least recently
+// used one is dropped. Mesh files a scene refers to are not part of the hash: a changed
+// mesh is only picked up through a changed scene file or a restart. "sceneHash" picks a
+// cached scene by the "hash" of an earlier reply, and fails once it has been dropped.
+//
+// "edits" change the job's scene before it renders, see scene_edit.h: materials, lights
+// and settings without touching the BVH, moved shapes by refitting it. The scene is
+// edited in the cache, where it goes by a new hash from then on (of its old hash and the
+// edits, the reply's "hash"), so a client making edit after edit sends each against the
+// hash the last one returned. The scene file itself no longer matches anything cached
+// and loads afresh when asked for. The reply adds "editMs" and "bvh" ("kept", "refit" or
+// "rebuilt"). A scene an edit fails on is dropped from the cache, it may be half edited.
+//
+// Jobs run one at a time, each spread over the whole thread pool. Clients are polled
+// together and their sockets don't block, so one idle connection doesn't hold up the
+// others. A reply the client isn't reading waits in its output buffer, and that client's
+// next jobs wait until the reply has gone out.
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <nlohmann/json.hpp>
+#include "Vec3.h"
+#include "arena.h"
+#include "image_writer.h"
+#include "mapped_file.h"
+#include "pinhole_camera.h"
+#include "scene.h"
+#include "scene_edit.h"
+#include "scene_sax.h"
+
+class RenderServer {
+public:
+    // Loads a scene file, JSON or binary
+    using LoadFunction = std::function<Scene(const std::string& path)>;
+    // Renders camera's view of scene into image (camera.width * camera.height)
+    using RenderFunction = std::function<void(const Scene& scene, const PinholeCamera& camera, unsigned seed, Vec3* image)>;
+
+    RenderServer(const std::string& socketPath, size_t cacheSize, LoadFunction load, RenderFunction render)
+        : socketPath(socketPath), cacheSize(std::max<size_t>(cacheSize, 1)), load(std::move(load)),
+          render(std::move(render)) {
+        sockaddr_un address = socketAddress(socketPath);
+
+        // A socket file left behind by a server that is gone is replaced, a live one isn't
+        struct stat status;
+        if (lstat(socketPath.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) {
+            int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+            bool live = probe >= 0 && connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+            if (probe >= 0) {
+                close(probe);
+            }
+            if (live) {
+                throw std::runtime_error("Another server is listening on " + socketPath);
+            }
+            unlink(socketPath.c_str());
+        }
+
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0) {
+            throw std::runtime_error("Failed to create socket: " + std::string(std::strerror(errno)));
+        }
+        if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 16) != 0) {
+            std::string reason = std::strerror(errno);
+            close(listener);
+            throw std::runtime_error("Failed to listen on " + socketPath + ": " + reason);
+        }
+    }
+
+    ~RenderServer() {
+        for (const Client& client : clients) {
+            close(client.fd);
+        }
+        close(listener);
+        unlink(socketPath.c_str());
+    }
+
+    RenderServer(const RenderServer&) = delete;
+    RenderServer& operator=(const RenderServer&) = delete;
+
+    // Serves clients until stop is set (from a signal handler) or a shutdown job arrives
+    void run(const volatile std::sig_atomic_t& stop) {
+        bool shutdown = false;
+        std::vector<pollfd> polled;
+        while (!stop && !shutdown) {
+            polled.assign(1, pollfd{listener, POLLIN, 0});
+            for (const Client& client : clients) {
+                polled.push_back(pollfd{client.fd, static_cast<short>(client.output.empty() ? POLLIN : POLLOUT), 0});
+            }
+            // Wakes up now and then to notice stop
+            if (poll(polled.data(), polled.size(), 200) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("Failed to poll sockets: " + std::string(std::strerror(errno)));
+            }
+
+            // Backwards, so dropping a client doesn't move the ones still to be served
+            for (size_t i = polled.size() - 1; i > 0 && !shutdown; --i) {
+                if (polled[i].revents != 0 && !serve(clients[i - 1], shutdown)) {
+                    close(clients[i - 1].fd);
+                    clients.erase(clients.begin() + static_cast<std::ptrdiff_t>(i - 1));
+                }
+            }
+            if (polled[0].revents & POLLIN) {
+                int fd = accept(listener, nullptr, nullptr);
+                if (fd >= 0 && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0) {
+                    clients.push_back(Client{fd});
+                } else if (fd >= 0) {
+                    close(fd);
+                }
+            }
+        }
+        std::cout << "Render server: " << jobs << " jobs, " << cacheHits << " from cached scenes, "
+                  << cache.size() << " scenes cached" << std::endl;
+    }
+
+private:
+    struct Client {
+        int fd;
+        std::string pending;    // received bytes not yet forming a whole line
+        std::string output;     // reply the client hasn't taken yet, no reading until it has
+        size_t sent = 0;        // bytes of output already sent
+        bool closing = false;   // drop the client once output is sent
+    };
+
+    struct CachedScene {
+        uint64_t hash;
+        Scene scene;
+        double loadMs;
+        double buildMs;
+    };
+
+    // A request line can carry a whole scene, but not without end
+    static const size_t maxRequestBytes = 64 * 1024 * 1024;
+
+    std::string socketPath;
+    size_t cacheSize;
+    LoadFunction load;
+    RenderFunction render;
+    int listener;
+    std::vector<Client> clients;
+    std::list<CachedScene> cache;  // most recently used first
+    size_t jobs = 0;
+    size_t cacheHits = 0;
+
+    static sockaddr_un socketAddress(const std::string& path) {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("Socket path must be 1 to " + std::to_string(sizeof(address.sun_path) - 1) +
+                                        " characters: " + path);
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size());
+        return address;
+    }
+
+    // FNV-1a, continuing from hash to hash more bytes onto an earlier hash
+    static uint64_t hashBytes(const char* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Sends more of the client's reply, or reads what it sent, then answers its complete
+    // lines as long as the replies go out whole. false once the client is gone or done.
+    bool serve(Client& client, bool& shutdown) {
+        if (!client.output.empty()) {
+            if (!flush(client)) {
+                return false;
+            }
+        } else {
+            char buffer[64 * 1024];
+            ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+            if (received < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return true;
+            }
+            if (received <= 0) {
+                return false;
+            }
+            client.pending.append(buffer, static_cast<size_t>(received));
+        }
+
+        size_t newline;
+        while (client.output.empty() && !client.closing && !shutdown &&
+               (newline = client.pending.find('\n')) != std::string::npos) {
+            std::string line = client.pending.substr(0, newline);
+            client.pending.erase(0, newline + 1);
+            if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                continue;
+            }
+            client.output = handle(line, shutdown);
+            if (!flush(client)) {
+                return false;
+            }
+        }
+        if (!client.closing && client.output.empty() && client.pending.size() > maxRequestBytes) {
+            client.output = errorReply("Request longer than " + std::to_string(maxRequestBytes) + " bytes");
+            client.closing = true;
+            if (!flush(client)) {
+                return false;
+            }
+        }
+        return !(client.closing && client.output.empty());
+    }
+
+    // Sends as much of the client's output as its socket takes without blocking. false
+    // once the client can't be written to.
+    static bool flush(Client& client) {
+        while (client.sent < client.output.size()) {
+            ssize_t n = send(client.fd, client.output.data() + client.sent, client.output.size() - client.sent,
+                             MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return true;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            client.sent += static_cast<size_t>(n);
+        }
+        client.output.clear();
+        client.output.shrink_to_fit();  // an image, don't keep it around for an idle client
+        client.sent = 0;
+        return true;
+    }
+
+    static std::string errorReply(const std::string& message) {
+        nlohmann::json reply = {{"ok", false}, {"error", message}};
+        return reply.dump() + "\n";
+    }
+
+    // The reply to one job line, header and image
+    std::string handle(const std::string& line, bool& shutdown) {
+        try {
+            nlohmann::json request = nlohmann::json::parse(line);
+            if (!request.is_object()) {
+                throw std::invalid_argument("A job must be a JSON object");
+            }
+            if (request.contains("command")) {
+                if (request["command"] != "shutdown") {
+                    throw std::invalid_argument("Unknown command: " + request["command"].dump());
+                }
+                shutdown = true;
+                return nlohmann::json({{"ok", true}}).dump() + "\n";
+            }
+            return renderJob(request);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: render job failed: " << e.what() << "\n";
+            return errorReply(e.what());
+        }
+    }
+
+    std::string renderJob(const nlohmann::json& request) {
+        bool cached = false;
+        CachedScene& entry = findScene(request, cached);
+        const Scene& scene = entry.scene;
+        long long view = request.value("view", 0LL);
+        if (view < 0 || static_cast<size_t>(view) >= scene.cameras.size()) {
+            throw std::invalid_argument("No view " + std::to_string(view) + ", the scene has " +
+                                        std::to_string(scene.cameras.size()) + " cameras");
+        }
+        PinholeCamera camera = scene.cameras[static_cast<size_t>(view)];
+        if (request.contains("camera")) {
+            applyCamera(request["camera"], camera);
+        }
+        unsigned seed = request.value("seed", 0u);
+        bool rendered = request.value("render", true);
+
+        SceneEditResult edited;
+        double editMs = 0.0;
+        if (request.contains("edits")) {
+            editMs = editScene(entry, request["edits"], edited);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::string ppm;
+        if (rendered) {
+            std::vector<Vec3> image(static_cast<size_t>(camera.width) * camera.height);
+            render(scene, camera, seed, image.data());
+            ppm = ImageWriter::encodeBinaryPPM(camera.width, camera.height, image.data());
+        }
+        double renderMs = millisecondsSince(start);
+
+        ++jobs;
+        cacheHits += cached ? 1 : 0;
+        char hash[17];
+        std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(entry.hash));
+        std::cout << "Job " << jobs << ": scene " << hash << (cached ? " (cached)" : "");
+        if (request.contains("edits")) {
+            std::cout << ", " << edited.edits << " edits in " << editMs << " ms (BVH " << edited.bvh << ")";
+        }
+        if (rendered) {
+            std::cout << ", " << camera.width << "x" << camera.height << " rendered in " << renderMs << " ms";
+        }
+        std::cout << std::endl;
+
+        nlohmann::json reply = {{"ok", true}, {"width", camera.width}, {"height", camera.height},
+                                {"bytes", ppm.size()}, {"cached", cached}, {"hash", hash},
+                                {"loadMs", cached ? 0.0 : entry.loadMs}, {"buildMs", cached ? 0.0 : entry.buildMs},
+                                {"renderMs", renderMs}};
+        if (request.contains("edits")) {
+            reply["editMs"] = editMs;
+            reply["bvh"] = edited.bvh;
+        }
+        return reply.dump() + "\n" + ppm;
+    }
+
+    // Applies a job's edits to its scene, the front of the cache, and rehashes it. Returns
+    // the milliseconds taken.
+    double editScene(CachedScene& entry, const nlohmann::json& edits, SceneEditResult& result) {
+        auto start = std::chrono::steady_clock::now();
+        try {
+            Arena scratch;
+            result = SceneEditor::apply(entry.scene, edits, scratch);
+        } catch (...) {
+            cache.pop_front();
+            throw;
+        }
+        double editMs = millisecondsSince(start);
+
+        std::string text = edits.dump();
+        entry.hash = hashBytes(text.data(), text.size(), entry.hash);
+        // The same edits of the same scene may be cached already, from an earlier job
+        for (auto it = std::next(cache.begin()); it != cache.end(); ++it) {
+            if (it->hash == entry.hash) {
+                cache.erase(it);
+                break;
+            }
+        }
+        return editMs;
+    }
+
+    // The job's scene from the cache, loaded and built first if it isn't there
+    CachedScene& findScene(const nlohmann::json& request, bool& cached) {
+        std::string path, text;
+        uint64_t hash;
+        if (request.contains("sceneHash")) {
+            std::string id = request["sceneHash"].get<std::string>();
+            size_t parsed = 0;
+            try {
+                hash = std::stoull(id, &parsed, 16);
+            } catch (const std::exception&) {
+                parsed = 0;
+            }
+            if (id.size() != 16 || parsed != id.size()) {
+                throw std::invalid_argument("\"sceneHash\" needs to be a hash from an earlier reply: " + id);
+            }
+        } else if (request.contains("scene")) {
+            path = request["scene"].get<std::string>();
+            MappedFile file(path);
+            hash = hashBytes(file.data(), file.size());
+        } else if (request.contains("sceneJson")) {
+            text = request["sceneJson"].dump();
+            hash = hashBytes(text.data(), text.size());
+        } else {
+            throw std::invalid_argument("A job needs \"scene\" (a file), \"sceneJson\" or \"sceneHash\"");
+        }
+
+        for (auto it = cache.begin(); it != cache.end(); ++it) {
+            if (it->hash == hash) {
+                cache.splice(cache.begin(), cache, it);
+                cached = true;
+                return cache.front();
+            }
+        }
+
+        if (request.contains("sceneHash")) {
+            throw std::invalid_argument("Scene " + request["sceneHash"].get<std::string>() +
+                                        " is not cached (any more), send the scene again");
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        Scene scene = path.empty() ? JsonSceneLoader::parse(text.data(), text.data() + text.size()) : load(path);
+        double loadMs = millisecondsSince(start);
+        start = std::chrono::steady_clock::now();
+        Arena scratch;
+        scene.buildBVH(scratch);
+        double buildMs = millisecondsSince(start);
+
+        cache.push_front(CachedScene{hash, std::move(scene), loadMs, buildMs});
+        while (cache.size() > cacheSize) {
+            cache.pop_back();
+        }
+        cached = false;
+        return cache.front();
+    }
+
+    static Vec3 vec3Field(const nlohmann::json& object, const char* name) {
+        const nlohmann::json& value = object[name];
+        if (!value.is_array() || value.size() != 3 || !value[0].is_number() || !value[1].is_number() ||
+            !value[2].is_number()) {
+            throw std::invalid_argument(std::string("Camera '") + name + "' needs to be [x, y, z]");
+        }
+        return Vec3(value[0].get<double>(), value[1].get<double>(), value[2].get<double>());
+    }
+
+    static void applyCamera(const nlohmann::json& fields, PinholeCamera& camera) {
+        if (!fields.is_object()) {
+            throw std::invalid_argument("\"camera\" needs to be an object");
+        }
+        if (fields.contains("position")) camera.position = vec3Field(fields, "position");
+        if (fields.contains("lookAt")) camera.lookAt = vec3Field(fields, "lookAt");
+        if (fields.contains("upVector")) camera.upVector = vec3Field(fields, "upVector");
+        camera.fov = fields.value("fov", camera.fov);
+        camera.exposure = fields.value("exposure", camera.exposure);
+        camera.width = fields.value("width", camera.width);
+        camera.height = fields.value("height", camera.height);
+        camera.aperture = fields.value("aperture", camera.aperture);
+        if (camera.width <= 0 || camera.height <= 0 || camera.width > 16384 || camera.height > 16384) {
+            throw std::invalid_argument("Camera width and height need to be 1 to 16384");
+        }
+        camera.initialize();
+    }
+};
+
+#endif // RENDER_SERVER_H
@@ -0,0 +1,271 @@
+// render_stats.h
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// Work done by the renderer. Every thread bumps its own copy, so counting needs no
+// atomics; the copies are summed when the stats are read.
+struct RenderCounters {
+    uint64_t primaryRays = 0;
+    uint64_t shadowRays = 0;
+    uint64_t reflectionRays = 0;
+    uint64_t refractionRays = 0;
+    uint64_t primitiveTests = 0;
+    uint64_t boxTests = 0;
+    uint64_t shadingCalls = 0;
+    uint64_t textureSamples = 0;
+    uint64_t terminatedPaths = 0;  // stopped early by roulette or the throughput cutoff
+
+    uint64_t totalRays() const {
+        return primaryRays + shadowRays + reflectionRays + refractionRays;
+    }
+
+    // Camera and bounce rays per path, every primary ray starts one
+    double averagePathLength() const {
+        return primaryRays > 0 ? static_cast<double>(primaryRays + reflectionRays + refractionRays) / primaryRays : 0.0;
+    }
+
+    RenderCounters& operator+=(const RenderCounters& other) {
+        primaryRays += other.primaryRays;
+        shadowRays += other.shadowRays;
+        reflectionRays += other.reflectionRays;
+        refractionRays += other.refractionRays;
+        primitiveTests += other.primitiveTests;
+        boxTests += other.boxTests;
+        shadingCalls += other.shadingCalls;
+        textureSamples += other.textureSamples;
+        terminatedPaths += other.terminatedPaths;
+        return *this;
+    }
+};
+
+// Process wide counters and stage timings
+class RenderStats {
+public:
+    // The calling thread's counters, registered on first use
+    static RenderCounters& local() {
+        thread_local ThreadSlot slot;
+        return slot.counters;
+    }
+
+    // Sum over all threads, including ones that already exited. Live threads keep
+    // counting while this runs, so read it once the workers are done.
+    static RenderCounters merged() {
+        Registry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        RenderCounters total = registry.retired;
+        for (const RenderCounters* counters : registry.live) {
+            total += *counters;
+        }
+        return total;
+    }
+
+    static void reset() {
+        Registry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.retired = RenderCounters();
+        for (RenderCounters* counters : registry.live) {
+            *counters = RenderCounters();
+        }
+        registry.stages.clear();
+    }
+
+    // Stages keep the order they were first seen in, repeated stages add up
+    static void addStageTime(const std::string& stage, double seconds) {
+        Registry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (auto& entry : registry.stages) {
+            if (entry.first == stage) {
+                entry.second += seconds;
+                return;
+            }
+        }
+        registry.stages.emplace_back(stage, seconds);
+    }
+
+    static double stageTime(const std::string& stage) {
+        Registry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (const auto& entry : registry.stages) {
+            if (entry.first == stage) {
+                return entry.second;
+            }
+        }
+        return 0.0;
+    }
+
+    static std::vector<std::pair<std::string, double>> stageTimes() {
+        Registry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        return registry.stages;
+    }
+
+    // Rays of every kind per second of the "render" stage, in millions
+    static double mraysPerSecond() {
+        double seconds = stageTime("render");
+        return seconds > 0.0 ? merged().totalRays() / seconds * 1e-6 : 0.0;
+    }
+
+    // Peak resident set of this process in KB. On Linux VmHWM is used since it only
+    // covers this program image, ru_maxrss also counts the parent a fork came from.
+    static long peakRssKB() {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.compare(0, 6, "VmHWM:") == 0) {
+                return std::stol(line.substr(6));
+            }
+        }
+#ifndef _WIN32
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+            return usage.ru_maxrss / 1024;  // bytes on macOS
+#else
+            return usage.ru_maxrss;
+#endif
+        }
+#endif
+        return 0;
+    }
+
+    static void printSummary(std::ostream& out) {
+        RenderCounters counters = merged();
+        std::ios::fmtflags flags = out.flags();
+        out << "---- render stats ----\n";
+        out << "primary rays:    " << counters.primaryRays << "\n";
+        out << "shadow rays:     " << counters.shadowRays << "\n";
+        out << "reflection rays: " << counters.reflectionRays << "\n";
+        out << "refraction rays: " << counters.refractionRays << "\n";
+        out << "primitive tests: " << counters.primitiveTests << "\n";
+        out << "box tests:       " << counters.boxTests << "\n";
+        out << "shading calls:   " << counters.shadingCalls << "\n";
+        out << "texture samples: " << counters.textureSamples << "\n";
+        out << "paths cut short: " << counters.terminatedPaths << "\n";
+        out << std::fixed << std::setprecision(3);
+        out << "avg path length: " << counters.averagePathLength() << "\n";
+        for (const auto& stage : stageTimes()) {
+            out << stage.first << " time: " << stage.second * 1000.0 << " ms\n";
+        }
+        out << "peak RSS:        " << peakRssKB() / 1024.0 << " MB\n";
+        out << "Mrays/s:         " << mraysPerSecond() << "\n";
+        out.flags(flags);
+    }
+
+    static nlohmann::json toJSON(const std::string& sceneName) {
+        RenderCounters counters = merged();
+        nlohmann::json j;
+        j["scene"] = sceneName;
+        j["build"] = buildId();
+        j["counters"] = {
+            {"primary_rays", counters.primaryRays},
+            {"shadow_rays", counters.shadowRays},
+            {"reflection_rays", counters.reflectionRays},
+            {"refraction_rays", counters.refractionRays},
+            {"total_rays", counters.totalRays()},
+            {"primitive_tests", counters.primitiveTests},
+            {"box_tests", counters.boxTests},
+            {"shading_calls", counters.shadingCalls},
+            {"texture_samples", counters.textureSamples},
+            {"terminated_paths", counters.terminatedPaths}
+        };
+        j["average_path_length"] = counters.averagePathLength();
+        nlohmann::json stages = nlohmann::json::object();
+        for (const auto& stage : stageTimes()) {
+            stages[stage.first] = stage.second;
+        }
+        j["stage_seconds"] = stages;
+        j["mrays_per_second"] = mraysPerSecond();
+        j["peak_rss_kb"] = peakRssKB();
+        return j;
+    }
+
+    static void writeJSON(const std::string& filename, const std::string& sceneName) {
+        std::ofstream file(filename);
+        if (!file) {
+            throw std::runtime_error("Cannot write stats file: " + filename);
+        }
+        file << toJSON(sceneName).dump(2) << "\n";
+    }
+
+    // Set at compile time with -DRT_BUILD_ID=..., the Makefile passes the git revision
+    static std::string buildId() {
+#ifdef RT_BUILD_ID
+        return RT_BUILD_ID;
+#else
+        return "unknown";
+#endif
+    }
+
+private:
+    struct Registry {
+        std::mutex mutex;
+        std::vector<RenderCounters*> live;
+        RenderCounters retired;  // counts of threads that have exited
+        std::vector<std::pair<std::string, double>> stages;
+    };
+
+    // Owns one thread's counters and hands them to the registry for its lifetime
+    struct ThreadSlot {
+        RenderCounters counters;
+
+        ThreadSlot() {
+            Registry& registry = instance();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.live.push_back(&counters);
+        }
+
+        ~ThreadSlot() {
+            Registry& registry = instance();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.retired += counters;
+            for (size_t i = 0; i < registry.live.size(); ++i) {
+                if (registry.live[i] == &counters) {
+                    registry.live.erase(registry.live.begin() + i);
+                    break;
+                }
+            }
+        }
+    };
+
+    static Registry& instance() {
+        // Never destroyed, thread_local slots may still unregister during exit
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+};
+
+// Adds the time between construction and destruction to a named stage
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const std::string& stage)
+        : stage(stage), start(std::chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        RenderStats::addStageTime(stage, elapsed.count());
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    std::string stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // RENDER_STATS_H
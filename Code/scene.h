@@ -0,0 +1,105 @@
+// scene.h
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "Vec3.h"
+#include "Sphere.h"
+#include "Cylinder.h"
+#include "Triangle.h"
+#include "pinhole_camera.h"
+#include "point_light.h"
+#include "BVH.h"
+#include "arena.h"
+#include "keyframes.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Everything read from a scene file, independent of the format it came from
+class Scene {
+public:
+    std::vector<PinholeCamera> cameras;
+    std::vector<Sphere> spheres;
+    std::vector<Cylinder> cylinders;
+    std::vector<Triangle> triangles;
+    std::vector<Material> materials;  // of the triangles, by Triangle::getMaterialIndex()
+    std::vector<PointLight> lights;
+    Vec3 backgroundColor;
+    int nbounces;
+    std::string rendermode;
+    std::vector<ObjectTrack> tracks;  // keyframed shapes, see keyframes.h
+    CameraTrack cameraTrack;          // keyframed path of cameras[0]
+    bool motionBlur = false;          // some primitives move while the shutter is open
+    BVH bvh;  // over spheres, cylinders and triangles, call buildBVH() after changing them
+
+    Scene() : backgroundColor(0.0f, 0.0f, 0.0f), nbounces(1), rendermode("binary") {}
+
+    // Index of material for a new triangle. Runs of triangles with the same material,
+    // a mesh or consecutive ones in the file, share one entry.
+    uint32_t addMaterial(const Material& material) {
+        if (materials.empty() || !(materials.back() == material)) {
+            materials.push_back(material);
+        }
+        return static_cast<uint32_t>(materials.size() - 1);
+    }
+
+    void buildBVH(Arena& scratch) {
+        bvh.build(spheres, cylinders, triangles, scratch);
+    }
+
+    // For primitives that moved since buildBVH(), see BVH::refit()
+    float refitBVH() {
+        return bvh.refit(spheres, cylinders, triangles);
+    }
+
+    // Motion blur: gives every primitive the state it has in closed, the same scene at the
+    // time the shutter closes, see Sphere::setShutterClose()
+    void setShutterClose(const Scene& closed) {
+        motionBlur = false;
+        for (size_t i = 0; i < spheres.size(); ++i) {
+            spheres[i].setShutterClose(closed.spheres[i]);
+            motionBlur = motionBlur || spheres[i].isMoving();
+        }
+        for (size_t i = 0; i < cylinders.size(); ++i) {
+            cylinders[i].setShutterClose(closed.cylinders[i]);
+            motionBlur = motionBlur || cylinders[i].isMoving();
+        }
+        for (size_t i = 0; i < triangles.size(); ++i) {
+            triangles[i].setShutterClose(closed.triangles[i]);
+            motionBlur = motionBlur || triangles[i].isMoving();
+        }
+    }
+
+    bool animated() const {
+        return !tracks.empty() || !cameraTrack.empty();
+    }
+
+    // Frame of the last key of any track
+    float lastKeyframe() const {
+        float last = cameraTrack.lastFrame();
+        for (const ObjectTrack& track : tracks) {
+            last = std::max(last, track.lastFrame());
+        }
+        return last;
+    }
+
+    // Normal and material of a BVH hit at the given point, by a ray traced at time
+    void surfaceAt(const PrimitiveRef& primitive, const Vec3& point, float time, Vec3& normal, Material& material) const {
+        if (primitive.type == PRIMITIVE_SPHERE) {
+            const Sphere& sphere = spheres[primitive.index];
+            normal = sphere.normalAt(point, time);
+            material = sphere.getMaterial();
+        } else if (primitive.type == PRIMITIVE_CYLINDER) {
+            const Cylinder& cylinder = cylinders[primitive.index];
+            normal = cylinder.normalAt(point, time);
+            material = cylinder.getMaterial();
+        } else {
+            const Triangle& triangle = triangles[primitive.index];
+            normal = triangle.normal(time);
+            material = materials[triangle.getMaterialIndex()];
+        }
+    }
+};
+
+#endif // SCENE_H
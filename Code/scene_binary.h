@@ -0,0 +1,421 @@
+// scene_binary.h
+//
+// Binary scene container (.rtsc), an alternative to the JSON scene files for large
+// generated scenes. The loader maps the file and reads the records in place, there
+// is no text parsing and no intermediate document. The renderer still works on its own
+// Sphere/Cylinder/Triangle vectors, so toScene() copies every record into those once;
+// what the format saves is the parsing, not that copy.
+//
+// Layout (little endian, every field is 4 bytes unless noted):
+//
+//   SceneFileHeader                 magic "RTSC", version, sectionCount, reserved
+//   SceneSectionEntry[sectionCount] type, count, offset (8 bytes), size (8 bytes)
+//   section payloads                each starts on a 16 byte boundary
+//
+// A section payload is a plain array of `count` records of the type below. Offsets
+// are from the start of the file and size must equal count * sizeof(record).
+//
+//   Settings   (1 record)  nbounces, rendermode (char[16], zero padded), backgroundcolor
+//   Cameras                position, lookAt, upVector, fov, exposure, width, height, aperture
+//   Lights                 position, intensity (already divided by 255)
+//   Materials              ks, kd, ka, specularexponent, diffusecolor, specularcolor,
+//                          isreflective, reflectivity, isrefractive, refractiveindex
+//   Spheres                center, radius, material index
+//   Cylinders              base center, axis, radius, full height, material index
+//   Triangles              v0, v1, v2, material index
+//
+// Cylinders are stored in the renderer's internal form: the JSON center is moved to
+// the base and the height is doubled on load, so the converter writes those values.
+// Primitives reference materials by index, identical materials are stored once.
+// Unknown section types are ignored so newer files stay readable.
+
+#ifndef SCENE_BINARY_H
+#define SCENE_BINARY_H
+
+#include "scene.h"
+#include "mapped_file.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum SceneSectionType : uint32_t {
+    SECTION_SETTINGS = 1,
+    SECTION_CAMERAS = 2,
+    SECTION_LIGHTS = 3,
+    SECTION_MATERIALS = 4,
+    SECTION_SPHERES = 5,
+    SECTION_CYLINDERS = 6,
+    SECTION_TRIANGLES = 7
+};
+
+struct SceneFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t sectionCount;
+    uint32_t reserved;
+};
+
+struct SceneSectionEntry {
+    uint32_t type;
+    uint32_t count;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct SettingsRecord {
+    int32_t nbounces;
+    char rendermode[16];
+    float backgroundcolor[3];
+};
+
+struct CameraRecord {
+    float position[3];
+    float lookAt[3];
+    float upVector[3];
+    float fov;
+    float exposure;
+    int32_t width;
+    int32_t height;
+    float aperture;
+};
+
+struct LightRecord {
+    float position[3];
+    float intensity[3];
+};
+
+struct MaterialRecord {
+    float ks;
+    float kd;
+    float ka;
+    float specularexponent;
+    float diffusecolor[3];
+    float specularcolor[3];
+    uint32_t isreflective;
+    float reflectivity;
+    uint32_t isrefractive;
+    float refractiveindex;
+};
+
+struct SphereRecord {
+    float center[3];
+    float radius;
+    uint32_t material;
+};
+
+struct CylinderRecord {
+    float center[3];
+    float axis[3];
+    float radius;
+    float height;
+    uint32_t material;
+};
+
+struct TriangleRecord {
+    float v0[3];
+    float v1[3];
+    float v2[3];
+    uint32_t material;
+};
+
+static const uint32_t sceneFileVersion = 1;
+
+// Writes a Scene as a .rtsc file
+class BinarySceneWriter {
+public:
+    static void write(const Scene& scene, const std::string& filename) {
+        SettingsRecord settings;
+        std::memset(&settings, 0, sizeof(settings));
+        settings.nbounces = scene.nbounces;
+        std::strncpy(settings.rendermode, scene.rendermode.c_str(), sizeof(settings.rendermode) - 1);
+        storeVec3(settings.backgroundcolor, scene.backgroundColor);
+
+        std::vector<CameraRecord> cameras;
+        for (const auto& camera : scene.cameras) {
+            CameraRecord record;
+            storeVec3(record.position, camera.position);
+            storeVec3(record.lookAt, camera.lookAt);
+            storeVec3(record.upVector, camera.upVector);
+            record.fov = camera.fov;
+            record.exposure = static_cast<float>(camera.exposure);
+            record.width = camera.width;
+            record.height = camera.height;
+            record.aperture = camera.aperture;
+            cameras.push_back(record);
+        }
+
+        std::vector<LightRecord> lights;
+        for (const auto& light : scene.lights) {
+            LightRecord record;
+            storeVec3(record.position, light.position);
+            storeVec3(record.intensity, light.intensity);
+            lights.push_back(record);
+        }
+
+        MaterialTable materials;
+
+        std::vector<SphereRecord> spheres;
+        for (const auto& sphere : scene.spheres) {
+            SphereRecord record;
+            storeVec3(record.center, sphere.center);
+            record.radius = sphere.radius;
+            record.material = materials.indexOf(sphere.getMaterial());
+            spheres.push_back(record);
+        }
+
+        std::vector<CylinderRecord> cylinders;
+        for (const auto& cylinder : scene.cylinders) {
+            CylinderRecord record;
+            storeVec3(record.center, cylinder.center);
+            storeVec3(record.axis, cylinder.axis);
+            record.radius = cylinder.radius;
+            record.height = cylinder.height;
+            record.material = materials.indexOf(cylinder.getMaterial());
+            cylinders.push_back(record);
+        }
+
+        std::vector<TriangleRecord> triangles;
+        for (const auto& triangle : scene.triangles) {
+            TriangleRecord record;
+            storeVec3(record.v0, triangle.v0);
+            storeVec3(record.v1, triangle.v1);
+            storeVec3(record.v2, triangle.v2);
+            record.material = materials.indexOf(scene.materials[triangle.getMaterialIndex()]);
+            triangles.push_back(record);
+        }
+
+        // Lay out the section table, then the payloads
+        std::vector<SceneSectionEntry> entries;
+        std::vector<const void*> payloads;
+        addSection(entries, payloads, SECTION_SETTINGS, 1, sizeof(SettingsRecord), &settings);
+        addSection(entries, payloads, SECTION_CAMERAS, cameras.size(), sizeof(CameraRecord), cameras.data());
+        addSection(entries, payloads, SECTION_LIGHTS, lights.size(), sizeof(LightRecord), lights.data());
+        addSection(entries, payloads, SECTION_MATERIALS, materials.records.size(), sizeof(MaterialRecord), materials.records.data());
+        addSection(entries, payloads, SECTION_SPHERES, spheres.size(), sizeof(SphereRecord), spheres.data());
+        addSection(entries, payloads, SECTION_CYLINDERS, cylinders.size(), sizeof(CylinderRecord), cylinders.data());
+        addSection(entries, payloads, SECTION_TRIANGLES, triangles.size(), sizeof(TriangleRecord), triangles.data());
+
+        uint64_t offset = alignUp(sizeof(SceneFileHeader) + entries.size() * sizeof(SceneSectionEntry));
+        for (auto& entry : entries) {
+            entry.offset = offset;
+            offset = alignUp(offset + entry.size);
+        }
+
+        std::ofstream file(filename, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open file for writing: " + filename);
+        }
+
+        SceneFileHeader header;
+        std::memcpy(header.magic, "RTSC", 4);
+        header.version = sceneFileVersion;
+        header.sectionCount = static_cast<uint32_t>(entries.size());
+        header.reserved = 0;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(SceneSectionEntry));
+
+        for (size_t i = 0; i < entries.size(); ++i) {
+            pad(file, entries[i].offset);
+            file.write(static_cast<const char*>(payloads[i]), entries[i].size);
+        }
+
+        if (!file) {
+            throw std::runtime_error("Failed to write scene file: " + filename);
+        }
+    }
+
+private:
+    // Deduplicates materials by their stored bytes
+    struct MaterialTable {
+        std::vector<MaterialRecord> records;
+        std::unordered_map<std::string, uint32_t> lookup;
+
+        uint32_t indexOf(const Material& material) {
+            MaterialRecord record;
+            std::memset(&record, 0, sizeof(record));
+            record.ks = material.ks;
+            record.kd = material.kd;
+            record.ka = material.ka;
+            record.specularexponent = material.specularexponent;
+            storeVec3(record.diffusecolor, material.diffusecolor);
+            storeVec3(record.specularcolor, material.specularcolor);
+            record.isreflective = material.isreflective ? 1 : 0;
+            record.reflectivity = material.reflectivity;
+            record.isrefractive = material.isrefractive ? 1 : 0;
+            record.refractiveindex = material.refractiveindex;
+
+            std::string key(reinterpret_cast<const char*>(&record), sizeof(record));
+            auto found = lookup.find(key);
+            if (found != lookup.end()) {
+                return found->second;
+            }
+            uint32_t index = static_cast<uint32_t>(records.size());
+            records.push_back(record);
+            lookup.emplace(key, index);
+            return index;
+        }
+    };
+
+    static void storeVec3(float* out, const Vec3& v) {
+        out[0] = v.x;
+        out[1] = v.y;
+        out[2] = v.z;
+    }
+
+    static uint64_t alignUp(uint64_t offset) {
+        return (offset + 15) & ~static_cast<uint64_t>(15);
+    }
+
+    static void pad(std::ofstream& file, uint64_t offset) {
+        static const char zeros[16] = {};
+        uint64_t position = static_cast<uint64_t>(file.tellp());
+        if (offset > position) {
+            file.write(zeros, offset - position);
+        }
+    }
+
+    static void addSection(std::vector<SceneSectionEntry>& entries, std::vector<const void*>& payloads,
+                           uint32_t type, size_t count, size_t recordSize, const void* data) {
+        // The count field is 32 bits, a bigger section would come out truncated and unreadable
+        if (count > std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error("Too many records for one scene section: " + std::to_string(count));
+        }
+        SceneSectionEntry entry;
+        entry.type = type;
+        entry.count = static_cast<uint32_t>(count);
+        entry.offset = 0;
+        entry.size = count * recordSize;
+        entries.push_back(entry);
+        payloads.push_back(data);
+    }
+};
+
+// Read-only view of a mapped .rtsc file. The section accessors return pointers
+// straight into the mapping, nothing is copied until toScene() builds the renderer objects.
+class BinarySceneFile {
+public:
+    BinarySceneFile(const std::string& filename) : file(filename), filename(filename) {
+        if (file.size() < sizeof(SceneFileHeader)) {
+            throw std::runtime_error("Scene file is too small: " + filename);
+        }
+
+        header = reinterpret_cast<const SceneFileHeader*>(file.data());
+        if (std::memcmp(header->magic, "RTSC", 4) != 0) {
+            throw std::runtime_error("Not a binary scene file: " + filename);
+        }
+        if (header->version != sceneFileVersion) {
+            throw std::runtime_error("Unsupported binary scene version in: " + filename);
+        }
+        if (sizeof(SceneFileHeader) + static_cast<uint64_t>(header->sectionCount) * sizeof(SceneSectionEntry) > file.size()) {
+            throw std::runtime_error("Truncated section table in: " + filename);
+        }
+        entries = reinterpret_cast<const SceneSectionEntry*>(file.data() + sizeof(SceneFileHeader));
+    }
+
+    // Typed pointer to a section's records, or nullptr (count 0) if the file has none
+    template <typename Record>
+    const Record* section(uint32_t type, size_t& count) const {
+        for (uint32_t i = 0; i < header->sectionCount; ++i) {
+            const SceneSectionEntry& entry = entries[i];
+            if (entry.type != type) {
+                continue;
+            }
+            if (entry.size != static_cast<uint64_t>(entry.count) * sizeof(Record) ||
+                entry.offset % alignof(Record) != 0 ||
+                entry.offset > file.size() || entry.size > file.size() - entry.offset) {
+                throw std::runtime_error("Corrupt section in binary scene file: " + filename);
+            }
+            count = entry.count;
+            return reinterpret_cast<const Record*>(file.data() + entry.offset);
+        }
+        count = 0;
+        return nullptr;
+    }
+
+    // Copies the records into a Scene, the mapping isn't needed afterwards
+    Scene toScene() const {
+        Scene scene;
+        size_t count = 0;
+
+        const SettingsRecord* settings = section<SettingsRecord>(SECTION_SETTINGS, count);
+        if (settings != nullptr && count > 0) {
+            scene.nbounces = settings->nbounces;
+            scene.rendermode = std::string(settings->rendermode, strnlen(settings->rendermode, sizeof(settings->rendermode)));
+            scene.backgroundColor = loadVec3(settings->backgroundcolor);
+        }
+
+        const CameraRecord* cameras = section<CameraRecord>(SECTION_CAMERAS, count);
+        for (size_t i = 0; i < count; ++i) {
+            const CameraRecord& c = cameras[i];
+            scene.cameras.emplace_back(loadVec3(c.position), loadVec3(c.lookAt), loadVec3(c.upVector),
+                                       c.fov, c.exposure, c.width, c.height, c.aperture);
+        }
+
+        const LightRecord* lights = section<LightRecord>(SECTION_LIGHTS, count);
+        for (size_t i = 0; i < count; ++i) {
+            scene.lights.emplace_back(loadVec3(lights[i].position), loadVec3(lights[i].intensity));
+        }
+
+        size_t materialCount = 0;
+        const MaterialRecord* materialRecords = section<MaterialRecord>(SECTION_MATERIALS, materialCount);
+        std::vector<Material> materials;
+        materials.reserve(materialCount);
+        for (size_t i = 0; i < materialCount; ++i) {
+            const MaterialRecord& m = materialRecords[i];
+            materials.emplace_back(m.ks, m.kd, m.ka, m.specularexponent,
+                                   loadVec3(m.diffusecolor), loadVec3(m.specularcolor),
+                                   m.isreflective != 0, m.reflectivity, m.isrefractive != 0, m.refractiveindex);
+        }
+
+        const SphereRecord* spheres = section<SphereRecord>(SECTION_SPHERES, count);
+        scene.spheres.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            scene.spheres.emplace_back(loadVec3(spheres[i].center), spheres[i].radius,
+                                       materialAt(materials, spheres[i].material));
+        }
+
+        const CylinderRecord* cylinders = section<CylinderRecord>(SECTION_CYLINDERS, count);
+        scene.cylinders.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            scene.cylinders.emplace_back(loadVec3(cylinders[i].center), loadVec3(cylinders[i].axis),
+                                         cylinders[i].radius, cylinders[i].height,
+                                         materialAt(materials, cylinders[i].material));
+        }
+
+        // Triangles keep the file's material indices, the table becomes Scene::materials
+        const TriangleRecord* triangles = section<TriangleRecord>(SECTION_TRIANGLES, count);
+        scene.triangles.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            materialAt(materials, triangles[i].material);
+            scene.triangles.emplace_back(loadVec3(triangles[i].v0), loadVec3(triangles[i].v1), loadVec3(triangles[i].v2),
+                                         triangles[i].material);
+        }
+        scene.materials = std::move(materials);
+
+        return scene;
+    }
+
+private:
+    MappedFile file;
+    std::string filename;
+    const SceneFileHeader* header;
+    const SceneSectionEntry* entries;
+
+    static Vec3 loadVec3(const float* v) {
+        return Vec3(v[0], v[1], v[2]);
+    }
+
+    const Material& materialAt(const std::vector<Material>& materials, uint32_t index) const {
+        if (index >= materials.size()) {
+            throw std::runtime_error("Material index out of range in binary scene file: " + filename);
+        }
+        return materials[index];
+    }
+};
+
+#endif // SCENE_BINARY_H
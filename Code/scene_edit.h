@@ -0,0 +1,308 @@
+// scene_edit.h
+//
+// Edits to a scene that is already loaded and built, so that a small change (a colour,
+// a light, one more sphere) doesn't cost a reload. The render service applies them to
+// its cached scenes, see render_server.h. Edits are a JSON list, applied in order:
+//
+//   {"op": "material", "sphere": 2, "set": {"diffusecolor": [1, 0, 0], "ks": 0.4}}
+//   {"op": "move", "triangle": 0, "count": 1200, "translate": [0, 0.1, 0]}
+//   {"op": "add", "shape": {"type": "sphere", "center": [0, 0, 1], "radius": 0.2, "material": {...}}}
+//   {"op": "remove", "cylinder": 0}
+//   {"op": "light", "index": 0, "position": [1, 2, 0], "intensity": [200, 200, 200]}
+//   {"op": "addLight", "light": {"position": [0, 3, 0], "intensity": [255, 255, 255]}}
+//   {"op": "removeLight", "index": 1}
+//   {"op": "settings", "backgroundcolor": [0.1, 0.1, 0.1], "nbounces": 4, "rendermode": "phong"}
+//
+// Shapes are picked by their index among the scene's spheres, cylinders or triangles in
+// the order they were loaded (the triangles of meshes come after the file's single
+// triangles), "count" picks that many from there on. "set" takes any of the fields of a
+// material in the scene file and leaves the others as they are. Added shapes and lights
+// use the scene file's fields and units and go after the existing ones; removing one
+// moves the ones after it down.
+//
+// Only what the edits touch is redone. Materials, lights and settings aren't in the BVH
+// and leave it as it is. Moved shapes refit it, which keeps the tree and recomputes the
+// boxes, until it has grown past bvhRebuildGrowth and is rebuilt. Adding or removing
+// shapes rebuilds it, as its leaves index the primitives.
+#ifndef SCENE_EDIT_H
+#define SCENE_EDIT_H
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "Vec3.h"
+#include "arena.h"
+#include "material.h"
+#include "point_light.h"
+#include "scene.h"
+
+// What SceneEditor::apply() did
+struct SceneEditResult {
+    size_t edits = 0;
+    const char* bvh = "kept";  // "kept", "refit" or "rebuilt"
+};
+
+class SceneEditor {
+public:
+    // Applies edits to scene and brings its BVH up to date. Throws on the first edit
+    // that fails, the ones before it stay applied and the BVH may be out of date then.
+    static SceneEditResult apply(Scene& scene, const nlohmann::json& edits, Arena& scratch) {
+        if (!edits.is_array()) {
+            throw std::invalid_argument("\"edits\" needs to be a list");
+        }
+        bool moved = false, restructured = false;
+        for (const nlohmann::json& edit : edits) {
+            if (!edit.is_object() || !edit.contains("op") || !edit["op"].is_string()) {
+                throw std::invalid_argument("Every edit needs an \"op\": " + edit.dump());
+            }
+            std::string op = edit["op"].get<std::string>();
+            if (op == "material") {
+                editMaterial(scene, edit);
+            } else if (op == "move") {
+                moveShapes(scene, edit);
+                moved = true;
+            } else if (op == "add") {
+                addShape(scene, edit);
+                restructured = true;
+            } else if (op == "remove") {
+                removeShapes(scene, edit);
+                restructured = true;
+            } else if (op == "light") {
+                PointLight& light = scene.lights[lightIndex(scene, edit)];
+                if (edit.contains("position")) light.position = vec3Field(edit, "position");
+                if (edit.contains("intensity")) light.intensity = vec3Field(edit, "intensity") / 255.0f;
+            } else if (op == "addLight") {
+                if (!edit.contains("light")) {
+                    throw std::invalid_argument("\"addLight\" needs a \"light\"");
+                }
+                scene.lights.emplace_back(edit["light"]);
+            } else if (op == "removeLight") {
+                scene.lights.erase(scene.lights.begin() + static_cast<std::ptrdiff_t>(lightIndex(scene, edit)));
+            } else if (op == "settings") {
+                if (edit.contains("backgroundcolor")) scene.backgroundColor = vec3Field(edit, "backgroundcolor");
+                int nbounces = edit.value("nbounces", scene.nbounces);
+                std::string rendermode = edit.value("rendermode", scene.rendermode);
+                if (nbounces < 1 || (rendermode != "binary" && rendermode != "phong")) {
+                    throw std::invalid_argument("Settings need nbounces of at least 1 and rendermode binary or phong");
+                }
+                scene.nbounces = nbounces;
+                scene.rendermode = rendermode;
+            } else {
+                throw std::invalid_argument("Unknown edit op: " + op);
+            }
+        }
+
+        SceneEditResult result;
+        result.edits = edits.size();
+        if (restructured || (moved && scene.refitBVH() > bvhRebuildGrowth)) {
+            scene.buildBVH(scratch);
+            result.bvh = "rebuilt";
+        } else if (moved) {
+            result.bvh = "refit";
+        }
+        return result;
+    }
+
+private:
+    // Shapes [first, first + count) of the spheres, cylinders or triangles
+    struct ShapeRange {
+        PrimitiveType type;
+        size_t first;
+        size_t count;
+    };
+
+    static Vec3 vec3Field(const nlohmann::json& object, const char* name) {
+        const nlohmann::json& value = object[name];
+        if (!value.is_array() || value.size() != 3 || !value[0].is_number() || !value[1].is_number() ||
+            !value[2].is_number()) {
+            throw std::invalid_argument(std::string("Edit field '") + name + "' needs to be [x, y, z]");
+        }
+        return Vec3(value[0].get<double>(), value[1].get<double>(), value[2].get<double>());
+    }
+
+    static size_t shapeCount(const Scene& scene, PrimitiveType type) {
+        return type == PRIMITIVE_SPHERE ? scene.spheres.size()
+             : type == PRIMITIVE_CYLINDER ? scene.cylinders.size() : scene.triangles.size();
+    }
+
+    static ShapeRange shapeRange(const Scene& scene, const nlohmann::json& edit) {
+        static const char* names[] = {"sphere", "cylinder", "triangle"};
+        static const PrimitiveType types[] = {PRIMITIVE_SPHERE, PRIMITIVE_CYLINDER, PRIMITIVE_TRIANGLE};
+        for (int i = 0; i < 3; ++i) {
+            if (!edit.contains(names[i])) {
+                continue;
+            }
+            long long first = edit[names[i]].get<long long>();
+            long long count = edit.value("count", 1LL);
+            size_t available = shapeCount(scene, types[i]);
+            if (first < 0 || count < 1 || static_cast<size_t>(first) + static_cast<size_t>(count) > available) {
+                throw std::out_of_range(std::string("No ") + names[i] + "s " + std::to_string(first) + " to " +
+                                        std::to_string(first + count - 1) + ", the scene has " +
+                                        std::to_string(available));
+            }
+            return ShapeRange{types[i], static_cast<size_t>(first), static_cast<size_t>(count)};
+        }
+        throw std::invalid_argument("Edit needs a \"sphere\", \"cylinder\" or \"triangle\" index: " + edit.dump());
+    }
+
+    static size_t lightIndex(const Scene& scene, const nlohmann::json& edit) {
+        long long index = edit.value("index", -1LL);
+        if (index < 0 || static_cast<size_t>(index) >= scene.lights.size()) {
+            throw std::out_of_range("No light " + std::to_string(index) + ", the scene has " +
+                                    std::to_string(scene.lights.size()));
+        }
+        return static_cast<size_t>(index);
+    }
+
+    // The fields of fields over material, as the scene file would give them
+    static void setMaterialFields(const nlohmann::json& fields, Material& material) {
+        if (!fields.is_object()) {
+            throw std::invalid_argument("\"set\" needs to be an object");
+        }
+        material.ks = fields.value("ks", material.ks);
+        material.kd = fields.value("kd", material.kd);
+        material.specularexponent = fields.value("specularexponent", material.specularexponent);
+        if (fields.contains("diffusecolor")) material.diffusecolor = vec3Field(fields, "diffusecolor");
+        if (fields.contains("specularcolor")) material.specularcolor = vec3Field(fields, "specularcolor");
+        material.isreflective = fields.value("isreflective", material.isreflective);
+        material.reflectivity = fields.value("reflectivity", material.reflectivity);
+        material.isrefractive = fields.value("isrefractive", material.isrefractive);
+        material.refractiveindex = fields.value("refractiveindex", material.refractiveindex);
+    }
+
+    template <typename Shape>
+    static void editMaterials(std::vector<Shape>& shapes, const ShapeRange& range, const nlohmann::json& fields) {
+        for (size_t i = range.first; i < range.first + range.count; ++i) {
+            Material material = shapes[i].getMaterial();
+            setMaterialFields(fields, material);
+            shapes[i].setMaterial(material);
+        }
+    }
+
+    // Triangles share their materials. An entry only edited triangles use is changed in
+    // place, one that triangles outside the range use too is copied for the edited ones,
+    // so editing the same triangles again and again doesn't grow the table.
+    static void editTriangleMaterials(Scene& scene, const ShapeRange& range, const nlohmann::json& fields) {
+        std::vector<bool> usedOutside(scene.materials.size(), false);
+        for (size_t i = 0; i < scene.triangles.size(); ++i) {
+            if (i < range.first || i >= range.first + range.count) {
+                usedOutside[scene.triangles[i].getMaterialIndex()] = true;
+            }
+        }
+
+        std::unordered_map<uint32_t, uint32_t> edited;
+        for (size_t i = range.first; i < range.first + range.count; ++i) {
+            Triangle& triangle = scene.triangles[i];
+            uint32_t index = triangle.getMaterialIndex();
+            auto found = edited.find(index);
+            if (found == edited.end()) {
+                if (usedOutside[index]) {
+                    Material material = scene.materials[index];
+                    setMaterialFields(fields, material);
+                    scene.materials.push_back(material);
+                    found = edited.emplace(index, static_cast<uint32_t>(scene.materials.size() - 1)).first;
+                } else {
+                    setMaterialFields(fields, scene.materials[index]);
+                    found = edited.emplace(index, index).first;
+                }
+            }
+            triangle.setMaterialIndex(found->second);
+        }
+    }
+
+    static void editMaterial(Scene& scene, const nlohmann::json& edit) {
+        ShapeRange range = shapeRange(scene, edit);
+        if (!edit.contains("set")) {
+            throw std::invalid_argument("\"material\" needs the fields to \"set\"");
+        }
+        const nlohmann::json& fields = edit["set"];
+        if (range.type == PRIMITIVE_SPHERE) {
+            editMaterials(scene.spheres, range, fields);
+        } else if (range.type == PRIMITIVE_CYLINDER) {
+            editMaterials(scene.cylinders, range, fields);
+        } else {
+            editTriangleMaterials(scene, range, fields);
+        }
+    }
+
+    static void moveShapes(Scene& scene, const nlohmann::json& edit) {
+        ShapeRange range = shapeRange(scene, edit);
+        if (!edit.contains("translate")) {
+            throw std::invalid_argument("\"move\" needs a \"translate\"");
+        }
+        Vec3 offset = vec3Field(edit, "translate");
+        for (size_t i = range.first; i < range.first + range.count; ++i) {
+            if (range.type == PRIMITIVE_SPHERE) {
+                scene.spheres[i].center += offset;
+            } else if (range.type == PRIMITIVE_CYLINDER) {
+                scene.cylinders[i].center += offset;
+            } else {
+                Triangle& triangle = scene.triangles[i];
+                triangle.v0 += offset;
+                triangle.v1 += offset;
+                triangle.v2 += offset;
+            }
+        }
+    }
+
+    // Same as the scene loader's
+    static Material shapeMaterial(const nlohmann::json& shape) {
+        if (!shape.contains("material") || !shape["material"].is_object()) {
+            return Material(0.0f, 0.0f, 0.0f, 1.0f, Vec3(0.0f, 0.0f, 0.0f), Vec3(0.0f, 0.0f, 0.0f), false, 0.0f, false, 1.0f);
+        }
+        return Material(shape["material"]);
+    }
+
+    static void addShape(Scene& scene, const nlohmann::json& edit) {
+        if (!edit.contains("shape") || !edit["shape"].is_object()) {
+            throw std::invalid_argument("\"add\" needs a \"shape\"");
+        }
+        const nlohmann::json& shape = edit["shape"];
+        std::string type = shape.value("type", std::string());
+        if (type == "sphere") {
+            scene.spheres.emplace_back(shape, shapeMaterial(shape));
+        } else if (type == "cylinder") {
+            scene.cylinders.emplace_back(shape, shapeMaterial(shape));
+        } else if (type == "triangle") {
+            scene.triangles.emplace_back(shape, scene.addMaterial(shapeMaterial(shape)));
+        } else {
+            throw std::invalid_argument("Can only add a sphere, cylinder or triangle, not '" + type + "'");
+        }
+    }
+
+    template <typename Shape>
+    static void eraseShapes(std::vector<Shape>& shapes, const ShapeRange& range) {
+        shapes.erase(shapes.begin() + static_cast<std::ptrdiff_t>(range.first),
+                     shapes.begin() + static_cast<std::ptrdiff_t>(range.first + range.count));
+    }
+
+    static void removeShapes(Scene& scene, const nlohmann::json& edit) {
+        ShapeRange range = shapeRange(scene, edit);
+        if (range.type == PRIMITIVE_SPHERE) {
+            eraseShapes(scene.spheres, range);
+        } else if (range.type == PRIMITIVE_CYLINDER) {
+            eraseShapes(scene.cylinders, range);
+        } else {
+            eraseShapes(scene.triangles, range);
+        }
+
+        // Keyframe tracks follow their shapes down, the ones of removed shapes go
+        auto& tracks = scene.tracks;
+        for (size_t i = 0; i < tracks.size();) {
+            ObjectTrack& track = tracks[i];
+            if (track.type != range.type || track.first + track.count <= range.first) {
+                ++i;
+            } else if (track.first >= range.first + range.count) {
+                track.first -= static_cast<uint32_t>(range.count);
+                ++i;
+            } else {
+                tracks.erase(tracks.begin() + static_cast<std::ptrdiff_t>(i));
+            }
+        }
+    }
+};
+
+#endif // SCENE_EDIT_H
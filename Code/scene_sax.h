@@ -0,0 +1,562 @@
+// scene_sax.h
+#ifndef SCENE_SAX_H
+#define SCENE_SAX_H
+
+#include "scene.h"
+#include "mapped_file.h"
+#include "mesh_loader.h"
+#include "material.h"
+#include <nlohmann/json.hpp>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Streaming JSON scene reader built on nlohmann's SAX interface. No document is
+// built: the fields of the object currently being read (the camera, one light or
+// one shape) are collected into a small reusable table and the primitive is pushed
+// into the Scene as soon as its closing brace arrives. Memory use is the size of
+// the Scene plus one object, however large the file is.
+class SceneSaxHandler : public nlohmann::json_sax<nlohmann::json> {
+public:
+    explicit SceneSaxHandler(Scene& scene) : scene(scene), sawRoot(false) {}
+
+    // Finish the scene after the parser is done: meshes are loaded last so the
+    // triangle order matches the file (plain triangles first). A mesh that fails to load
+    // throws, a scene without it would render wrong rather than fail.
+    void finish() {
+        if (!sawRoot) {
+            throw std::invalid_argument("Scene JSON is not an object");
+        }
+
+        for (const auto& pendingMesh : pendingMeshes) {
+            Mesh mesh = MeshLoader::load(pendingMesh.filename);
+            size_t first = scene.triangles.size();
+            mesh.appendTriangles(scene.triangles, scene.addMaterial(pendingMesh.material));
+            if (pendingMesh.animated) {
+                ObjectTrack track = pendingMesh.track;
+                track.first = static_cast<uint32_t>(first);
+                track.count = static_cast<uint32_t>(scene.triangles.size() - first);
+                scene.tracks.push_back(track);
+            }
+            std::cout << "Loaded mesh: " << pendingMesh.filename << " (" << mesh.vertices.size() << " vertices, "
+                      << mesh.triangleCount() << " triangles)" << std::endl;
+        }
+        pendingMeshes.clear();
+    }
+
+    bool null() override {
+        return true;
+    }
+
+    bool boolean(bool value) override {
+        if (FieldValue* field = valueField()) {
+            field->isBool = true;
+            field->boolean = value;
+        }
+        return true;
+    }
+
+    bool number_integer(number_integer_t value) override {
+        return number(static_cast<double>(value));
+    }
+
+    bool number_unsigned(number_unsigned_t value) override {
+        return number(static_cast<double>(value));
+    }
+
+    bool number_float(number_float_t value, const string_t&) override {
+        return number(static_cast<double>(value));
+    }
+
+    bool string(string_t& value) override {
+        if (FieldValue* field = valueField()) {
+            field->isString = true;
+            field->text = value;
+        }
+        return true;
+    }
+
+    bool binary(binary_t&) override {
+        return true;
+    }
+
+    bool start_object(std::size_t) override {
+        if (stack.empty()) {
+            sawRoot = true;
+            openRecord(RECORD_ROOT);
+            return true;
+        }
+
+        const Frame& parent = stack.back();
+        std::string name = fieldName(parent);
+
+        // Objects that start a new record, everything else is flattened into the current one.
+        // "camera" is one camera or a list of them.
+        if (parent.record == RECORD_ROOT && name == "camera") {
+            openRecord(RECORD_CAMERA);
+        } else if (parent.record == RECORD_ROOT && !parent.isArray && name == "scene") {
+            openRecord(RECORD_SCENE);
+        } else if (parent.record == RECORD_SCENE && parent.isArray && name == "lightsources") {
+            openRecord(RECORD_LIGHT);
+        } else if (parent.record == RECORD_SCENE && parent.isArray && name == "shapes") {
+            openRecord(RECORD_SHAPE);
+        } else {
+            RecordKind record = parent.record;
+            if (record != RECORD_NONE) {
+                fieldsOf(record).add(name).isObject = true;
+            }
+            stack.push_back(Frame{record, false, false, name + ".", ""});
+        }
+        return true;
+    }
+
+    bool end_object() override {
+        Frame frame = stack.back();
+        stack.pop_back();
+        if (frame.opensRecord) {
+            emit(frame.record);
+        }
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        RecordKind record = RECORD_NONE;
+        std::string name;
+        if (!stack.empty()) {
+            const Frame& parent = stack.back();
+            record = parent.record;
+            name = fieldName(parent);
+            // Nested arrays keep appending to the outer array's field
+            if (!parent.isArray && record != RECORD_NONE) {
+                fieldsOf(record).add(name).isArray = true;
+            }
+        }
+        stack.push_back(Frame{record, false, true, name, ""});
+        return true;
+    }
+
+    bool end_array() override {
+        stack.pop_back();
+        return true;
+    }
+
+    bool key(string_t& value) override {
+        stack.back().key = value;
+        return true;
+    }
+
+    bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& ex) override {
+        throw std::runtime_error("JSON parse error at byte " + std::to_string(position) + ": " + ex.what());
+    }
+
+private:
+    enum RecordKind { RECORD_NONE, RECORD_ROOT, RECORD_CAMERA, RECORD_SCENE, RECORD_LIGHT, RECORD_SHAPE };
+
+    struct FieldValue {
+        std::string name;
+        std::vector<double> numbers;
+        std::string text;
+        bool boolean;
+        bool isBool;
+        bool isString;
+        bool isArray;
+        bool isObject;
+    };
+
+    // Flat key -> value table for one JSON object. Nested keys are joined with '.'
+    // ("material.ks") and arrays collect their numbers. Entries are reused between
+    // objects, so reading thousands of shapes does not allocate per shape.
+    struct FieldSet {
+        std::vector<FieldValue> fields;
+        size_t used = 0;
+
+        void clear() {
+            used = 0;
+        }
+
+        FieldValue& add(const std::string& name) {
+            if (used == fields.size()) {
+                fields.emplace_back();
+            }
+            FieldValue& field = fields[used++];
+            field.name = name;
+            field.numbers.clear();
+            field.text.clear();
+            field.boolean = false;
+            field.isBool = false;
+            field.isString = false;
+            field.isArray = false;
+            field.isObject = false;
+            return field;
+        }
+
+        FieldValue* find(const std::string& name) {
+            for (size_t i = used; i > 0; --i) {
+                if (fields[i - 1].name == name) {
+                    return &fields[i - 1];
+                }
+            }
+            return nullptr;
+        }
+
+        const FieldValue* find(const std::string& name) const {
+            return const_cast<FieldSet*>(this)->find(name);
+        }
+
+        bool has(const std::string& name) const {
+            return find(name) != nullptr;
+        }
+
+        bool getNumber(const std::string& name, double& value) const {
+            const FieldValue* field = find(name);
+            if (field == nullptr || field->isArray || field->numbers.size() != 1) {
+                return false;
+            }
+            value = field->numbers[0];
+            return true;
+        }
+
+        float number(const std::string& name, float defaultValue) const {
+            double value;
+            return getNumber(name, value) ? static_cast<float>(value) : defaultValue;
+        }
+
+        bool flag(const std::string& name, bool defaultValue) const {
+            const FieldValue* field = find(name);
+            return (field != nullptr && field->isBool) ? field->boolean : defaultValue;
+        }
+
+        bool getVec3(const std::string& name, Vec3& value) const {
+            const FieldValue* field = find(name);
+            if (field == nullptr || !field->isArray || field->numbers.size() != 3) {
+                return false;
+            }
+            value = Vec3(field->numbers[0], field->numbers[1], field->numbers[2]);
+            return true;
+        }
+
+        bool getString(const std::string& name, std::string& value) const {
+            const FieldValue* field = find(name);
+            if (field == nullptr || !field->isString) {
+                return false;
+            }
+            value = field->text;
+            return true;
+        }
+    };
+
+    struct Frame {
+        RecordKind record;
+        bool opensRecord;
+        bool isArray;
+        std::string prefix;   // key prefix for objects, field name for arrays
+        std::string key;      // last key seen in an object
+    };
+
+    struct PendingMesh {
+        std::string filename;
+        Material material;
+        ObjectTrack track;  // the triangles are filled in once the mesh is loaded
+        bool animated;
+    };
+
+    Scene& scene;
+    std::vector<Frame> stack;
+    FieldSet rootFields;
+    FieldSet sceneFields;
+    FieldSet itemFields;   // the camera, light or shape being read
+    std::vector<PendingMesh> pendingMeshes;
+    bool sawRoot;
+
+    static std::string fieldName(const Frame& frame) {
+        return frame.isArray ? frame.prefix : frame.prefix + frame.key;
+    }
+
+    FieldSet& fieldsOf(RecordKind record) {
+        if (record == RECORD_ROOT) return rootFields;
+        if (record == RECORD_SCENE) return sceneFields;
+        return itemFields;
+    }
+
+    void openRecord(RecordKind record) {
+        fieldsOf(record).clear();
+        stack.push_back(Frame{record, true, false, "", ""});
+    }
+
+    // Field a scalar value goes to, or nullptr if it is outside any record
+    FieldValue* valueField() {
+        if (stack.empty() || stack.back().record == RECORD_NONE) {
+            return nullptr;
+        }
+        const Frame& frame = stack.back();
+        FieldSet& fields = fieldsOf(frame.record);
+        if (frame.isArray) {
+            FieldValue* field = fields.find(frame.prefix);
+            return field != nullptr ? field : &fields.add(frame.prefix);
+        }
+        return &fields.add(fieldName(frame));
+    }
+
+    bool number(double value) {
+        if (FieldValue* field = valueField()) {
+            field->numbers.push_back(value);
+        }
+        return true;
+    }
+
+    void emit(RecordKind record) {
+        switch (record) {
+            case RECORD_ROOT: emitSettings(); break;
+            case RECORD_CAMERA: emitCamera(); break;
+            case RECORD_SCENE: emitBackground(); break;
+            case RECORD_LIGHT: emitLight(); break;
+            case RECORD_SHAPE: emitShape(); break;
+            default: break;
+        }
+    }
+
+    void emitSettings() {
+        double nbounces;
+        scene.nbounces = rootFields.getNumber("nbounces", nbounces) ? static_cast<int>(nbounces) : 1; // Adjust the default value as needed
+        if (!rootFields.getString("rendermode", scene.rendermode)) {
+            throw std::invalid_argument("Invalid or missing 'rendermode' key in scene JSON");
+        }
+    }
+
+    void emitCamera() {
+        const FieldSet& f = itemFields;
+        Vec3 position, lookAt, upVector;
+        double fov, exposure, width, height;
+        if (!f.getVec3("position", position) || !f.getVec3("lookAt", lookAt) || !f.getVec3("upVector", upVector) ||
+            !f.getNumber("fov", fov) || !f.getNumber("exposure", exposure) ||
+            !f.getNumber("width", width) || !f.getNumber("height", height)) {
+            throw std::invalid_argument("Invalid or missing key in camera JSON");
+        }
+        float aperture = 0.1f;  // Default aperture value
+        scene.cameras.emplace_back(position, lookAt, upVector, static_cast<float>(fov), exposure,
+                                   static_cast<int>(width), static_cast<int>(height), aperture);
+
+        bool smooth = smoothCurves();
+        bool animated = readCurve("position", smooth, scene.cameraTrack.position);
+        animated = readCurve("lookAt", smooth, scene.cameraTrack.lookAt) || animated;
+        if (animated && scene.cameras.size() > 1) {
+            throw std::invalid_argument("Only the first camera can be animated");
+        }
+
+        // A turntable, "orbit": {"views": 24, "degrees": 360, "axis": [0, 1, 0]}: views
+        // cameras spread evenly over degrees (360 by default) about the axis (the up
+        // vector by default) through lookAt, starting with this one
+        double views;
+        if (f.getNumber("orbit.views", views)) {
+            double degrees = 360.0;
+            f.getNumber("orbit.degrees", degrees);
+            Vec3 axis = upVector;
+            f.getVec3("orbit.axis", axis);
+            if (views < 1 || views > 100000 || axis.length() == 0.0f) {
+                throw std::invalid_argument("Camera orbit needs 1 to 100000 views and a nonzero axis");
+            }
+            if (animated) {
+                throw std::invalid_argument("An orbiting camera can't be animated");
+            }
+            axis = axis.normalized();
+            for (int view = 1; view < static_cast<int>(views); ++view) {
+                float angle = static_cast<float>(degrees * view / static_cast<int>(views) * 3.14159265358979323846 / 180.0);
+                scene.cameras.emplace_back(lookAt + rotate(position - lookAt, axis, angle), lookAt,
+                                           rotate(upVector, axis, angle), static_cast<float>(fov), exposure,
+                                           static_cast<int>(width), static_cast<int>(height), aperture);
+            }
+        }
+    }
+
+    // v turned by angle (radians) about the unit vector axis, Rodrigues' formula
+    static Vec3 rotate(const Vec3& v, const Vec3& axis, float angle) {
+        float c = std::cos(angle), s = std::sin(angle);
+        return v * c + axis.cross(v) * s + axis * (Vec3::dot(axis, v) * (1.0f - c));
+    }
+
+    // "animation.interpolation" of the record being emitted, see keyframes.h
+    bool smoothCurves() const {
+        std::string interpolation = "linear";
+        itemFields.getString("animation.interpolation", interpolation);
+        if (interpolation != "linear" && interpolation != "smooth") {
+            throw std::invalid_argument("Unknown keyframe interpolation: " + interpolation + " (linear or smooth)");
+        }
+        return interpolation == "smooth";
+    }
+
+    // Reads the "animation.<name>" keyframes of the record being emitted, if it has them
+    bool readCurve(const std::string& name, bool smooth, KeyframeCurve& curve) const {
+        const FieldValue* field = itemFields.find("animation." + name);
+        if (field == nullptr) {
+            return false;
+        }
+        curve = KeyframeCurve::fromNumbers(field->numbers, name);
+        curve.smooth = smooth;
+        return true;
+    }
+
+    // The keyframes of the shape being emitted, false if it has none
+    bool shapeTrack(uint32_t type, const Vec3& centre, ObjectTrack& track) const {
+        bool smooth = smoothCurves();
+        bool animated = readCurve("translate", smooth, track.translate);
+        animated = readCurve("rotate", smooth, track.rotate) || animated;
+        animated = readCurve("scale", smooth, track.scale) || animated;
+        track.type = type;
+        track.pivot = centre;
+        itemFields.getVec3("animation.pivot", track.pivot);
+        return animated;
+    }
+
+    // Animates the last count primitives of the shape's type if it has keyframes
+    void addShapeTrack(uint32_t type, const Vec3& centre, size_t end, size_t count) {
+        ObjectTrack track;
+        if (shapeTrack(type, centre, track)) {
+            track.first = static_cast<uint32_t>(end - count);
+            track.count = static_cast<uint32_t>(count);
+            scene.tracks.push_back(track);
+        }
+    }
+
+    void emitBackground() {
+        Vec3 backgroundColor;
+        if (sceneFields.getVec3("backgroundcolor", backgroundColor)) {
+            scene.backgroundColor = backgroundColor;
+        } else {
+            std::cerr << "Warning: Using default background color.\n";
+            scene.backgroundColor = Vec3(0.0f, 0.0f, 0.0f);
+        }
+    }
+
+    void emitLight() {
+        std::string type;
+        if (!itemFields.getString("type", type)) {
+            std::cerr << "Error: Light source does not have a 'type' key.\n";
+            return;
+        }
+        if (type != "pointlight") {
+            std::cerr << "Error: Unsupported light type: " << type << "\n";
+            return;
+        }
+
+        Vec3 position, intensity;
+        if (!itemFields.getVec3("position", position)) {
+            throw std::invalid_argument("Invalid or missing 'position' key in PointLight JSON");
+        }
+        if (!itemFields.getVec3("intensity", intensity)) {
+            throw std::invalid_argument("Invalid or missing 'intensity' key in PointLight JSON");
+        }
+        scene.lights.emplace_back(position, intensity / 255.0f);
+    }
+
+    // Same defaults as Material(const nlohmann::json&) and parseMaterial
+    Material shapeMaterial() const {
+        const FieldValue* materialField = itemFields.find("material");
+        if (materialField == nullptr || !materialField->isObject) {
+            // If no material is specified, create a default material
+            return Material(0.0f, 0.0f, 0.0f, 1.0f, Vec3(0.0f, 0.0f, 0.0f), Vec3(0.0f, 0.0f, 0.0f), false, 0.0f, false, 1.0f);
+        }
+
+        Vec3 diffusecolor, specularcolor;
+        if (!itemFields.getVec3("material.diffusecolor", diffusecolor)) {
+            throw std::invalid_argument("Invalid or missing 'diffusecolor' key in Material JSON");
+        }
+        if (!itemFields.getVec3("material.specularcolor", specularcolor)) {
+            throw std::invalid_argument("Invalid or missing 'specularcolor' key in Material JSON");
+        }
+
+        return Material(itemFields.number("material.ks", 0.0f),
+                        itemFields.number("material.kd", 0.8f),
+                        0.2f,
+                        itemFields.number("material.specularexponent", 1.0f),
+                        diffusecolor, specularcolor,
+                        itemFields.flag("material.isreflective", false),
+                        itemFields.number("material.reflectivity", 0.0f),
+                        itemFields.flag("material.isrefractive", false),
+                        itemFields.number("material.refractiveindex", 1.0f));
+    }
+
+    void emitShape() {
+        const FieldSet& f = itemFields;
+        std::string type;
+        if (!f.getString("type", type)) {
+            std::cerr << "Error: Shape does not have a 'type' key.\n";
+            return;
+        }
+
+        if (type == "sphere") {
+            Vec3 center;
+            double radius;
+            if (!f.getVec3("center", center)) {
+                throw std::invalid_argument("Invalid or missing 'center' key in Sphere JSON");
+            }
+            if (!f.getNumber("radius", radius)) {
+                throw std::invalid_argument("Invalid or missing 'radius' key in Sphere JSON");
+            }
+            scene.spheres.emplace_back(center, static_cast<float>(radius), shapeMaterial());
+            addShapeTrack(PRIMITIVE_SPHERE, center, scene.spheres.size(), 1);
+        } else if (type == "cylinder") {
+            Vec3 center, axis;
+            double radius, height;
+            if (!f.getVec3("center", center)) {
+                throw std::invalid_argument("Invalid or missing 'center' key in Cylinder JSON");
+            }
+            if (!f.getVec3("axis", axis)) {
+                throw std::invalid_argument("Invalid or missing 'axis' key in Cylinder JSON");
+            }
+            if (!f.getNumber("radius", radius)) {
+                throw std::invalid_argument("Invalid or missing 'radius' key in Cylinder JSON");
+            }
+            if (!f.getNumber("height", height)) {
+                throw std::invalid_argument("Invalid or missing 'height' key in Cylinder JSON");
+            }
+            // double the height and move the center, as the JSON constructor does
+            float fullHeight = static_cast<float>(height) * 2;
+            scene.cylinders.emplace_back(center - axis * fullHeight / 2, axis, static_cast<float>(radius), fullHeight, shapeMaterial());
+            addShapeTrack(PRIMITIVE_CYLINDER, center, scene.cylinders.size(), 1);
+        } else if (type == "triangle") {
+            Vec3 v0, v1, v2;
+            if (!f.getVec3("v0", v0)) {
+                throw std::invalid_argument("Invalid or missing 'v0' key in Triangle JSON");
+            }
+            if (!f.getVec3("v1", v1)) {
+                throw std::invalid_argument("Invalid or missing 'v1' key in Triangle JSON");
+            }
+            if (!f.getVec3("v2", v2)) {
+                throw std::invalid_argument("Invalid or missing 'v2' key in Triangle JSON");
+            }
+            scene.triangles.emplace_back(v0, v1, v2, scene.addMaterial(shapeMaterial()));
+            addShapeTrack(PRIMITIVE_TRIANGLE, Vec3(0.0f, 0.0f, 0.0f), scene.triangles.size(), 1);
+        } else if (type == "mesh") {
+            std::string filename;
+            if (!f.getString("file", filename)) {
+                std::cerr << "Error: Mesh does not have a 'file' key.\n";
+                return;
+            }
+            PendingMesh mesh{filename, shapeMaterial(), ObjectTrack(), false};
+            mesh.animated = shapeTrack(PRIMITIVE_TRIANGLE, Vec3(0.0f, 0.0f, 0.0f), mesh.track);
+            pendingMeshes.push_back(mesh);
+        }
+    }
+};
+
+// Read a JSON scene file straight into a Scene
+class JsonSceneLoader {
+public:
+    static Scene load(const std::string& filename) {
+        MappedFile file(filename);
+        return parse(file.data(), file.data() + file.size());
+    }
+
+    // From JSON text already in memory
+    static Scene parse(const char* begin, const char* end) {
+        Scene scene;
+        SceneSaxHandler handler(scene);
+        nlohmann::json::sax_parse(begin, end, &handler);
+        handler.finish();
+        return scene;
+    }
+};
+
+#endif // SCENE_SAX_H
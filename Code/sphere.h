@@ -5,6 +5,7 @@
 #include "Vec3.h"
 #include <nlohmann/json.hpp>
 #include "material.h"
+#include "AABB.h"
 
 class Sphere {
 public:
@@ -13,6 +14,9 @@ public:
 
     //Sphere(const Vec3& center, float radius) : center(center), radius(radius) {}
 
+    Sphere(const Vec3& center, float radius, const Material& material)
+        : center(center), radius(radius), material(material) {}
+
     Sphere(const nlohmann::json& json, const Material& material) : Sphere(json) {
         this->material = material;
         
@@ -34,26 +38,62 @@ public:
     }
 
 }
-    Vec3 normalAt(const Vec3& point) const {
+    Vec3 normalAt(const Vec3& point, float time = 0.0f) const {
         // Calculate the normal vector at the given point on the sphere
-        return (point - center).normalized();
+        return (point - centerAt(time)).normalized();
     }
     // get the material
     Material getMaterial() const {
         return material;
     }
+    void setMaterial(const Material& material) {
+        this->material = material;
+    }
     //setcenter
     void setCenter(const Vec3& center) {
         this->center = center;
     }
+    // Box enclosing the sphere, used by the BVH
+    AABB getBoundingBox() const {
+        Vec3 extent(radius, radius, radius);
+        return AABB(center - extent, center + extent);
+    }
+
+    // Motion blur: where the sphere is when the shutter closes. A ray at time t sees it
+    // moved in a straight line from center and radius at 0 to centerEnd and radiusEnd at 1.
+    void setShutterClose(const Sphere& closed) {
+        centerEnd = closed.center;
+        radiusEnd = closed.radius;
+        moving = centerEnd != center || radiusEnd != radius;
+    }
+
+    bool isMoving() const {
+        return moving;
+    }
+
+    Vec3 centerAt(float time) const {
+        return moving ? center + (centerEnd - center) * time : center;
+    }
+
+    float radiusAt(float time) const {
+        return moving ? radius + (radiusEnd - radius) * time : radius;
+    }
+
+    // Box at shutter close, the same as getBoundingBox() for a sphere that doesn't move
+    AABB getBoundingBoxEnd() const {
+        Vec3 extent(radiusAt(1.0f), radiusAt(1.0f), radiusAt(1.0f));
+        return AABB(centerAt(1.0f) - extent, centerAt(1.0f) + extent);
+    }
     
 
 
     bool intersect(const Ray& ray, float& t) const {
-        Vec3 oc = ray.origin - center;
+        Vec3 position = centerAt(ray.time);
+        float r = radiusAt(ray.time);
+        Vec3 oc = ray.origin - position;
         float a = ray.direction.x * ray.direction.x + ray.direction.y * ray.direction.y + ray.direction.z * ray.direction.z;
         float b = 2.0f * (oc.x * ray.direction.x + oc.y * ray.direction.y + oc.z * ray.direction.z);
-        float c = oc.x * oc.x + oc.y * oc.y + oc.z * oc.z - radius * radius;
+        float c = oc.x * oc.x + oc.y * oc.y + oc.z * oc.z - r * r;
         float discriminant = b * b - 4 * a * c;
 
         if (discriminant < 0) {
@@ -67,6 +107,9 @@ public:
     }
 private:
     Material material;
+    Vec3 centerEnd;
+    float radiusEnd = 0.0f;
+    bool moving = false;
 };
 
 #endif // SPHERE_H
@@ -0,0 +1,134 @@
+// temporal.h
+//
+// Temporal reuse for animations (--reuse). When only a few objects move, most tiles of
+// a frame come out exactly as in the frame before, so only the tiles whose light paths
+// can see a change are rendered again and the rest are kept.
+//
+// Which tiles those are is found from the rays themselves. Every frame is rendered with
+// the same seed, so a tile traces the same rays frame after frame until one of them
+// meets something that moved. The boxes of what changes from one frame to the next (the
+// old and the new bounds of every moved object) are known up front. While a tile
+// renders, every ray it traces (camera, reflected, refracted and shadow rays, over the
+// interval they were traced for) is tested against the boxes of all later frames, and
+// the first later frame one of them touches is where the tile has to be rendered
+// again. Until then its rays, and so its pixels, can't change: nothing they meet has
+// moved and the random numbers they draw are the same. A tile that is rendered again
+// records its rays afresh.
+//
+// Tiles are the unit because each tile draws its random numbers from one engine, a
+// pixel can't be rendered on its own without the ones before it in the tile.
+#ifndef TEMPORAL_H
+#define TEMPORAL_H
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "AABB.h"
+#include "Ray.h"
+
+class TemporalReuse {
+public:
+    // changes[f]: boxes of what differs between frame f - 1 and frame f (changes[0] is
+    // ignored, the first frame renders every tile)
+    TemporalReuse(size_t tiles, const std::vector<std::vector<AABB>>& changes)
+        : changes(changes), nextDirty(tiles, 0) {
+        // Merge overlapping boxes, a moving object sweeps out one box over the animation
+        for (const auto& boxes : changes) {
+            for (AABB box : boxes) {
+                for (size_t i = 0; i < swept.size();) {
+                    if (overlaps(swept[i], box)) {
+                        box = AABB::surroundingBox(swept[i], box);
+                        swept.erase(swept.begin() + i);
+                        i = 0;
+                    } else {
+                        ++i;
+                    }
+                }
+                swept.push_back(box);
+            }
+        }
+    }
+
+    // Tiles that have to be rendered for frame, all of them for the first
+    std::vector<size_t> dirtyTiles(int frame) const {
+        std::vector<size_t> tiles;
+        for (size_t tile = 0; tile < nextDirty.size(); ++tile) {
+            if (frame == 0 || nextDirty[tile] == frame) {
+                tiles.push_back(tile);
+            }
+        }
+        return tiles;
+    }
+
+    // Records the rays traced on this thread for tile, which is being rendered for frame,
+    // until the Recording goes out of scope
+    class Recording {
+    public:
+        Recording(TemporalReuse& reuse, size_t tile, int frame) : reuse(reuse), tile(tile), frame(frame) {
+            reuse.nextDirty[tile] = never;
+            current() = this;
+        }
+        ~Recording() {
+            current() = nullptr;
+        }
+        Recording(const Recording&) = delete;
+        Recording& operator=(const Recording&) = delete;
+
+    private:
+        friend class TemporalReuse;
+        TemporalReuse& reuse;
+        size_t tile;
+        int frame;
+    };
+
+    // Called for every ray the renderer traces, over [tMin, tMax]. Costs a branch while
+    // nothing records.
+    static void trace(const Ray& ray, float tMin, float tMax) {
+        if (Recording* recording = current()) {
+            recording->reuse.record(*recording, ray, tMin, tMax);
+        }
+    }
+
+private:
+    static const int never = std::numeric_limits<int>::max();
+
+    std::vector<std::vector<AABB>> changes;
+    std::vector<AABB> swept;  // covers every box of changes, most rays miss it
+    std::vector<int> nextDirty;  // per tile, the next frame it has to be rendered for
+
+    static Recording*& current() {
+        thread_local Recording* recording = nullptr;
+        return recording;
+    }
+
+    static bool overlaps(const AABB& a, const AABB& b) {
+        return a.min.x <= b.max.x && b.min.x <= a.max.x && a.min.y <= b.max.y && b.min.y <= a.max.y &&
+               a.min.z <= b.max.z && b.min.z <= a.max.z;
+    }
+
+    static bool touches(const std::vector<AABB>& boxes, const Ray& ray, float tMin, float tMax) {
+        for (const AABB& box : boxes) {
+            if (box.intersect(ray, tMin, tMax)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Only the recording thread writes the tile's entry
+    void record(const Recording& recording, const Ray& ray, float tMin, float tMax) {
+        int& dirty = nextDirty[recording.tile];
+        if (dirty == recording.frame + 1 || !touches(swept, ray, tMin, tMax)) {
+            return;
+        }
+        int last = std::min(dirty, static_cast<int>(changes.size()));
+        for (int frame = recording.frame + 1; frame < last; ++frame) {
+            if (touches(changes[frame], ray, tMin, tMax)) {
+                dirty = frame;
+                return;
+            }
+        }
+    }
+};
+
+#endif // TEMPORAL_H
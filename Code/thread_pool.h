@@ -0,0 +1,145 @@
+// thread_pool.h
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads pulling tasks from one queue
+class ThreadPool {
+public:
+    // threads == 0 uses one worker per hardware thread
+    explicit ThreadPool(size_t threads = 0) : stopping(false) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (size_t i = 0; i < threads; ++i) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wakeup.notify_one();
+    }
+
+    // Runs fn(0) ... fn(count - 1) across the pool and returns when all are done.
+    // The calling thread works on the range as well, so calling this from inside a
+    // pool task can't deadlock, and the first exception thrown by fn is rethrown here.
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+        if (count == 0) {
+            return;
+        }
+
+        auto loop = std::make_shared<ForLoop>(count, fn);
+        size_t helpers = std::min(count - 1, workers.size());
+        for (size_t i = 0; i < helpers; ++i) {
+            submit([loop] { loop->run(); });
+        }
+        loop->run();
+
+        // Only indices some thread already took can still be running. Helpers that start
+        // after this find nothing left and exit, the shared_ptr keeps the loop alive.
+        std::unique_lock<std::mutex> lock(loop->mutex);
+        loop->finished.wait(lock, [&] { return loop->done == count; });
+        if (loop->error) {
+            std::rethrow_exception(loop->error);
+        }
+    }
+
+    // Index of the calling worker thread in [0, size()), or -1 off the pool
+    static int workerIndex() {
+        return currentWorker();
+    }
+
+private:
+    struct ForLoop {
+        size_t count;
+        std::function<void(size_t)> fn;
+        std::atomic<size_t> next;
+        size_t done;
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable finished;
+
+        ForLoop(size_t count, const std::function<void(size_t)>& fn) : count(count), fn(fn), next(0), done(0) {}
+
+        void run() {
+            size_t index;
+            while ((index = next.fetch_add(1)) < count) {
+                std::exception_ptr caught;
+                try {
+                    fn(index);
+                } catch (...) {
+                    caught = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                if (caught && !error) {
+                    error = caught;
+                }
+                if (++done == count) {
+                    finished.notify_all();
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping;
+
+    static int& currentWorker() {
+        thread_local int index = -1;
+        return index;
+    }
+
+    void workerLoop(size_t index) {
+        currentWorker() = static_cast<int>(index);
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,48 @@
+// tiles.h
+#ifndef TILES_H
+#define TILES_H
+
+#include <algorithm>
+#include <cstddef>
+
+// Pixel rectangle [x0, x1) x [y0, y1)
+struct TileRect {
+    int x0, y0, x1, y1;
+};
+
+// Splits a width x height image into square tiles, numbered row by row
+class TileGrid {
+public:
+    static const int defaultTileSize = 16;
+
+    TileGrid(int width, int height, int tileSize = defaultTileSize)
+        : width(width), height(height), tileSize(tileSize),
+          tilesX((width + tileSize - 1) / tileSize), tilesY((height + tileSize - 1) / tileSize) {}
+
+    size_t count() const {
+        return static_cast<size_t>(tilesX) * tilesY;
+    }
+
+    TileRect rect(size_t tile) const {
+        TileRect r;
+        r.x0 = static_cast<int>(tile % tilesX) * tileSize;
+        r.y0 = static_cast<int>(tile / tilesX) * tileSize;
+        r.x1 = std::min(r.x0 + tileSize, width);
+        r.y1 = std::min(r.y0 + tileSize, height);
+        return r;
+    }
+
+    // Random seed for a tile. Everything random in a tile is drawn from engines seeded
+    // with this, so a render only depends on the base seed, not on which thread ran what.
+    static unsigned seed(unsigned base, size_t tile) {
+        return base + static_cast<unsigned>(tile) * 0x9E3779B9u;
+    }
+
+    int width;
+    int height;
+    int tileSize;
+    int tilesX;
+    int tilesY;
+};
+
+#endif // TILES_H
@@ -0,0 +1,164 @@
+// trace.h
+//
+// Timeline recorder that dumps Chrome trace JSON (open it in chrome://tracing or
+// ui.perfetto.dev). Compiled in only with -DRT_TRACE (make TRACE=1); without it the
+// TRACE_* macros expand to nothing and the recorder costs nothing.
+//
+// Every thread appends to its own fixed size ring buffer, so recording takes no locks.
+// When a buffer wraps the oldest events are overwritten. Buffers are registered once
+// per thread and live until exit, so they can be dumped after the threads are gone.
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifdef RT_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+struct TraceEvent {
+    const char* name;      // string literals only, they are kept by pointer
+    const char* category;
+    uint64_t startNs;
+    uint64_t durationNs;
+    int64_t arg;           // e.g. tile index, -1 when unused
+};
+
+class Trace {
+public:
+    static const size_t bufferCapacity = 1 << 16;  // events per thread, power of two
+
+    static void enable() {
+        enabledFlag().store(true, std::memory_order_relaxed);
+    }
+
+    static bool enabled() {
+        return enabledFlag().load(std::memory_order_relaxed);
+    }
+
+    static uint64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - epoch()).count();
+    }
+
+    static void record(const char* name, const char* category, uint64_t startNs, uint64_t endNs, int64_t arg) {
+        ThreadBuffer& buffer = localBuffer();
+        uint64_t head = buffer.head.load(std::memory_order_relaxed);
+        buffer.events[head & (bufferCapacity - 1)] = TraceEvent{name, category, startNs, endNs - startNs, arg};
+        buffer.head.store(head + 1, std::memory_order_release);
+    }
+
+    // Call once the recording threads are idle, events written during the dump may be
+    // torn
+    static void write(const std::string& filename) {
+        nlohmann::json events = nlohmann::json::array();
+        Registry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (const auto& buffer : registry.buffers) {
+            events.push_back({{"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", buffer->tid},
+                              {"args", {{"name", buffer->tid == 0 ? "main" : "worker " + std::to_string(buffer->tid)}}}});
+            uint64_t head = buffer->head.load(std::memory_order_acquire);
+            uint64_t first = head > bufferCapacity ? head - bufferCapacity : 0;
+            for (uint64_t i = first; i < head; ++i) {
+                const TraceEvent& event = buffer->events[i & (bufferCapacity - 1)];
+                nlohmann::json entry = {
+                    {"name", event.name}, {"cat", event.category}, {"ph", "X"}, {"pid", 1}, {"tid", buffer->tid},
+                    {"ts", event.startNs / 1000.0}, {"dur", event.durationNs / 1000.0}
+                };
+                if (event.arg >= 0) {
+                    entry["args"] = {{"index", event.arg}};
+                }
+                events.push_back(entry);
+            }
+        }
+
+        std::ofstream file(filename);
+        if (!file) {
+            throw std::runtime_error("Cannot write trace file: " + filename);
+        }
+        file << nlohmann::json{{"traceEvents", events}, {"displayTimeUnit", "ms"}}.dump() << "\n";
+    }
+
+private:
+    struct ThreadBuffer {
+        int tid;
+        std::atomic<uint64_t> head;
+        std::unique_ptr<TraceEvent[]> events;
+
+        explicit ThreadBuffer(int tid) : tid(tid), head(0), events(new TraceEvent[bufferCapacity]) {}
+    };
+
+    struct Registry {
+        std::mutex mutex;  // only taken when a thread records for the first time and on dump
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    };
+
+    static Registry& instance() {
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+
+    static std::atomic<bool>& enabledFlag() {
+        static std::atomic<bool> flag(false);
+        return flag;
+    }
+
+    static std::chrono::steady_clock::time_point epoch() {
+        static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        return start;
+    }
+
+    static ThreadBuffer& localBuffer() {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (buffer == nullptr) {
+            Registry& registry = instance();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.buffers.emplace_back(new ThreadBuffer(static_cast<int>(registry.buffers.size())));
+            buffer = registry.buffers.back().get();
+        }
+        return *buffer;
+    }
+};
+
+// Records the lifetime of the scope as one complete event
+class TraceScope {
+public:
+    TraceScope(const char* name, const char* category, int64_t arg = -1)
+        : name(name), category(category), arg(arg), startNs(Trace::enabled() ? Trace::nowNs() : 0) {}
+
+    ~TraceScope() {
+        if (Trace::enabled()) {
+            Trace::record(name, category, startNs, Trace::nowNs(), arg);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    const char* category;
+    int64_t arg;
+    uint64_t startNs;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name, category) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name, category)
+#define TRACE_SCOPE_ARG(name, category, arg) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name, category, arg)
+
+#else
+
+#define TRACE_SCOPE(name, category) do {} while (0)
+#define TRACE_SCOPE_ARG(name, category, arg) do {} while (0)
+
+#endif // RT_TRACE
+
+#endif // TRACE_H
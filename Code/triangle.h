@@ -5,6 +5,8 @@
 #include "Vec3.h"
 #include <nlohmann/json.hpp>
 #include "material.h"
+#include "AABB.h"
+#include <cstdint>
 class Triangle {
 public:
     Vec3 v0, v1, v2;
@@ -12,7 +14,11 @@ public:
     Triangle(const Vec3& v1, const Vec3& v2, const Vec3& v3)
         : v0(v1), v1(v2), v2(v3) {}
 
-    Triangle(const nlohmann::json& json, const Material& material) : Triangle(json) {
+    // material is an index into Scene::materials, the faces of a mesh share one
+    Triangle(const Vec3& v1, const Vec3& v2, const Vec3& v3, uint32_t material)
+        : v0(v1), v1(v2), v2(v3), material(material) {}
+
+    Triangle(const nlohmann::json& json, uint32_t material) : Triangle(json) {
         this->material = material;
     }
 
@@ -39,18 +45,75 @@ public:
     }
 }
 
-Vec3 normal() const {
+Vec3 normal(float time = 0.0f) const {
+    if (moving) {
+        Vec3 a, b, c;
+        verticesAt(time, a, b, c);
+        return (b - a).cross(c - a).normalized();
+    }
     // Calculate the normal vector of the triangle
     return (v1-v0).cross(v2 - v0).normalized();
 }
-// get the material
-Material getMaterial() const {
+// index of the material in Scene::materials
+uint32_t getMaterialIndex() const {
     return material;
 }
+void setMaterialIndex(uint32_t material) {
+    this->material = material;
+}
+// Box enclosing the triangle, used by the BVH
+AABB getBoundingBox() const {
+    return boxOf(v0, v1, v2);
+}
+
+// Motion blur: where the triangle is when the shutter closes. A ray at time t sees every
+// vertex moved in a straight line from where it is at 0 to where it is at 1.
+void setShutterClose(const Triangle& closed) {
+    v0End = closed.v0;
+    v1End = closed.v1;
+    v2End = closed.v2;
+    moving = v0End != v0 || v1End != v1 || v2End != v2;
+}
+
+bool isMoving() const {
+    return moving;
+}
+
+// Box at shutter close, the same as getBoundingBox() for a triangle that doesn't move
+AABB getBoundingBoxEnd() const {
+    return moving ? boxOf(v0End, v1End, v2End) : getBoundingBox();
+}
 
 
 
     bool intersect(const Ray& ray, float& t) const {
+        if (!moving) {
+            return intersectVertices(ray, v0, v1, v2, t);
+        }
+        Vec3 a, b, c;
+        verticesAt(ray.time, a, b, c);
+        return intersectVertices(ray, a, b, c, t);
+    }
+
+    private:
+    uint32_t material = 0;
+    Vec3 v0End, v1End, v2End;
+    bool moving = false;
+
+    void verticesAt(float time, Vec3& a, Vec3& b, Vec3& c) const {
+        a = v0 + (v0End - v0) * time;
+        b = v1 + (v1End - v1) * time;
+        c = v2 + (v2End - v2) * time;
+    }
+
+    static AABB boxOf(const Vec3& v0, const Vec3& v1, const Vec3& v2) {
+        Vec3 low(std::min(v0.x, std::min(v1.x, v2.x)), std::min(v0.y, std::min(v1.y, v2.y)), std::min(v0.z, std::min(v1.z, v2.z)));
+        Vec3 high(std::max(v0.x, std::max(v1.x, v2.x)), std::max(v0.y, std::max(v1.y, v2.y)), std::max(v0.z, std::max(v1.z, v2.z)));
+        return AABB(low, high);
+    }
+
+    // Moller-Trumbore
+    static bool intersectVertices(const Ray& ray, const Vec3& v0, const Vec3& v1, const Vec3& v2, float& t) {
         Vec3 e1 = v1 - v0;
         Vec3 e2 = v2 - v0;
         Vec3 h = ray.direction.cross(e2);
@@ -79,9 +142,6 @@ Material getMaterial() const {
 
         return t > 0.00001;
     }
-
-    private:
-    Material material;
 };
 
 #endif // TRIANGLE_H
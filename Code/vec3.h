@@ -70,6 +70,14 @@ public:
         return Vec3(-x, -y, -z);
     }
 
+    bool operator==(const Vec3& other) const {
+        return x == other.x && y == other.y && z == other.z;
+    }
+
+    bool operator!=(const Vec3& other) const {
+        return !(*this == other);
+    }
+
     Vec3 normalized() const {
         float length = std::sqrt(x * x + y * y + z * z);
         return Vec3(x / length, y / length, z / length);
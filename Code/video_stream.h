@@ -0,0 +1,145 @@
+// video_stream.h
+//
+// Writes an animation as one uncompressed video stream instead of a PPM per frame, to a
+// file, a named pipe or stdout ("-"), so an encoder can take the frames as they finish:
+//
+//   ./main scene.json --animate 60 --video - | ffmpeg -i - out.mp4
+//   ./main scene.json --animate 60 --video frames.rgb --video-format rgb
+//   ffmpeg -f rawvideo -pix_fmt rgb24 -s 1200x800 -r 24 -i frames.rgb out.mp4
+//
+// Y4M is a YUV4MPEG2 header followed by "FRAME\n" and the Y, U and V planes of every
+// frame, 4:4:4 in BT.601 studio range. Raw RGB is just 3 bytes per pixel, frame after
+// frame. Pixels are quantised exactly like ImageWriter::writePPM, in the same order, so a
+// frame matches the frame_<n>.ppm it replaces. The YUV conversion is integer arithmetic
+// over separate R, G and B planes, a loop the compiler vectorises.
+#ifndef VIDEO_STREAM_H
+#define VIDEO_STREAM_H
+
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Vec3.h"
+
+class VideoStream {
+public:
+    enum Format { Y4M, RAW_RGB };
+
+    VideoStream(const std::string& path, Format format, int width, int height, int fps)
+        : path(path), format(format), width(width), height(height) {
+        file = path == "-" ? stdout : std::fopen(path.c_str(), "wb");
+        if (!file) {
+            throw std::runtime_error("Failed to open video stream for writing: " + path);
+        }
+
+        size_t pixels = static_cast<size_t>(width) * height;
+        if (format == Y4M) {
+            r.resize(pixels);
+            g.resize(pixels);
+            b.resize(pixels);
+            yuv.resize(3 * pixels);
+            std::string header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) +
+                                 " F" + std::to_string(fps) + ":1 Ip A1:1 C444\n";
+            put(header.data(), header.size());
+        } else {
+            rgb.resize(3 * pixels);
+        }
+    }
+
+    ~VideoStream() {
+        if (file && file != stdout) {
+            std::fclose(file);
+        } else if (file) {
+            std::fflush(file);
+        }
+    }
+
+    VideoStream(const VideoStream&) = delete;
+    VideoStream& operator=(const VideoStream&) = delete;
+
+    // Appends a width * height frame
+    void writeFrame(const Vec3* image) {
+        if (format == RAW_RGB) {
+            size_t o = 0;
+            forEachPixel(image, [&](uint8_t red, uint8_t green, uint8_t blue) {
+                rgb[o++] = red;
+                rgb[o++] = green;
+                rgb[o++] = blue;
+            });
+            put(rgb.data(), rgb.size());
+            return;
+        }
+
+        size_t o = 0;
+        forEachPixel(image, [&](uint8_t red, uint8_t green, uint8_t blue) {
+            r[o] = red;
+            g[o] = green;
+            b[o] = blue;
+            ++o;
+        });
+        convertToYUV();
+        put("FRAME\n", 6);
+        put(yuv.data(), yuv.size());
+    }
+
+    // Flushes, throws if anything written so far didn't make it
+    void finish() {
+        if (std::fflush(file) != 0 || std::ferror(file)) {
+            throw std::runtime_error("Failed to write video stream: " + path);
+        }
+    }
+
+private:
+    std::string path;
+    Format format;
+    int width;
+    int height;
+    std::FILE* file;
+    std::vector<uint8_t> r, g, b;  // planes of the frame being converted
+    std::vector<uint8_t> yuv;      // Y, U and V planes one after the other
+    std::vector<uint8_t> rgb;      // interleaved raw frame
+
+    void put(const void* data, size_t size) {
+        if (std::fwrite(data, 1, size, file) != size) {
+            throw std::runtime_error("Failed to write video stream: " + path);
+        }
+    }
+
+    static uint8_t quantise(float value) {
+        float clamped = (value < 0.0f) ? 0.0f : (value > 1.0f) ? 1.0f : value;
+        return static_cast<uint8_t>(255.99f * clamped);
+    }
+
+    // writePPM's pixel order: bottom row of the image first, right to left
+    template <typename Fn>
+    void forEachPixel(const Vec3* image, Fn fn) const {
+        for (int j = height - 1; j >= 0; --j) {
+            const Vec3* row = image + static_cast<size_t>(j) * width;
+            for (int i = width - 1; i >= 0; --i) {
+                fn(quantise(row[i].x), quantise(row[i].y), quantise(row[i].z));
+            }
+        }
+    }
+
+    // BT.601 studio range with 8 bit fixed point weights, the results are in range
+    // without clamping. Runs over whole planes with no branches, GCC vectorises it.
+    void convertToYUV() {
+        const size_t pixels = r.size();
+        const uint8_t* pR = r.data();
+        const uint8_t* pG = g.data();
+        const uint8_t* pB = b.data();
+        uint8_t* pY = yuv.data();
+        uint8_t* pU = pY + pixels;
+        uint8_t* pV = pU + pixels;
+#pragma GCC ivdep
+        for (size_t p = 0; p < pixels; ++p) {
+            int red = pR[p], green = pG[p], blue = pB[p];
+            pY[p] = static_cast<uint8_t>(((66 * red + 129 * green + 25 * blue + 128) >> 8) + 16);
+            pU[p] = static_cast<uint8_t>(((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128);
+            pV[p] = static_cast<uint8_t>(((112 * red - 94 * green - 18 * blue + 128) >> 8) + 128);
+        }
+    }
+};
+
+#endif // VIDEO_STREAM_H
@@ -0,0 +1,559 @@
+// wavefront.h
+//
+// Wavefront (stream) integrator, the alternative to the recursive computeColor path
+// (--integrator wavefront). Instead of following one path at a time, a batch of pixels
+// is turned into a queue of rays and every stage runs as a kernel over the whole queue:
+//
+//   generate  camera rays for the batch
+//   extend    closest hit for every ray
+//   shade     local lighting at every hit, one shadow ray per light, the path's next ray
+//   shadow    any-hit test for every shadow ray
+//   spawn     compact the continuing paths into the next queue, sorted so rays going
+//             the same way from nearby points are traced back to back
+//
+// and extend..spawn repeat until the queue runs dry. Queues are kept as structure of
+// arrays so a kernel streams through the few fields it needs. Kernels write per-ray
+// results only, and as the queue holds at most one ray per path, adding them to the
+// path's slot is a kernel like the others: every stage is split over the pool without
+// any locking.
+//
+// The shading matches calculateShading() and paths continue through continuePath() like
+// in computeColor(), so the queue never grows past one ray per path. The random numbers
+// for those choices come from a small generator carried with each ray, which keeps the
+// image independent of thread count and sort order.
+//
+// renderPixel() averages samplesPerPixel paths from the pixel's camera ray. They only
+// differ where a random number is drawn: Fresnel branches of materials that reflect and
+// refract, Russian roulette and the shutter time under motion blur. A scene with none of
+// those gets samplesPerPixel identical paths there, and one here. Otherwise every pixel
+// gets samplesPerPixel paths, each with its own random state, averaged before tone
+// mapping like renderPixel() does, so both integrators give the same image up to noise
+// and at the same noise level.
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+#include "Ray.h"
+#include "Vec3.h"
+#include "material.h"
+#include "optics.h"
+#include "pinhole_camera.h"
+#include "render_stats.h"
+#include "scene.h"
+#include "thread_pool.h"
+#include "tiles.h"
+#include "trace.h"
+
+class WavefrontIntegrator {
+public:
+    // Sorting pays off once the BVH no longer fits in cache, on small scenes it's pure
+    // overhead. SORT_AUTO sorts when the BVH nodes take more than sortThresholdBytes.
+    enum RaySort { SORT_OFF, SORT_ON, SORT_AUTO };
+    static const size_t sortThresholdBytes = 1024 * 1024;
+
+    // renderPixel()'s num_samples
+    static const int samplesPerPixel = 10;
+
+    // batchPaths bounds the memory of the queues, about that many paths are in flight
+    // at once
+    explicit WavefrontIntegrator(ThreadPool& pool, size_t batchPaths = 64 * 1024, RaySort raySort = SORT_AUTO,
+                                 const PathTermination& termination = PathTermination())
+        : pool(pool), batchPaths(std::max<size_t>(batchPaths, 1)), raySort(raySort), termination(termination),
+          sortSecondary(false) {}
+
+    // Writes tone mapped colours to image (camera.width * camera.height), background
+    // included in phong mode, the same as the tile renderer does
+    void render(const PinholeCamera& camera, const Scene& scene, int nbounces, bool phong,
+                Vec3* image, unsigned seed) {
+        TileGrid tiles(camera.width, camera.height);
+        std::vector<Vec3> accum;
+        sortSecondary = raySort == SORT_ON ||
+                        (raySort == SORT_AUTO && scene.bvh.arenaStats().bytesInUse > sortThresholdBytes);
+        int samples = randomPaths(scene, phong) ? samplesPerPixel : 1;
+
+        size_t tile = 0;
+        while (tile < tiles.count()) {
+            // Take whole tiles until the batch is full, each tile's camera rays are drawn
+            // from its own seed exactly like in renderImage()
+            std::vector<size_t> batchTiles;
+            std::vector<size_t> offsets;
+            size_t pixels = 0;
+            while (tile < tiles.count() && (pixels == 0 || pixels * samples < batchPaths)) {
+                TileRect rect = tiles.rect(tile);
+                batchTiles.push_back(tile);
+                offsets.push_back(pixels);
+                pixels += static_cast<size_t>(rect.x1 - rect.x0) * (rect.y1 - rect.y0);
+                ++tile;
+            }
+
+            accum.assign(pixels * samples, Vec3(0.0f, 0.0f, 0.0f));
+            pixelIndex.resize(pixels);
+            generate(camera, tiles, batchTiles, offsets, nbounces, samples, scene.motionBlur, seed);
+
+            while (rays.size() > 0) {
+                extend(scene);
+                shade(scene, nbounces, phong);
+                traceShadows(scene);
+                accumulate(accum);
+                spawn(scene);
+            }
+
+            forChunks(pixels, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    Vec3 color(0.0f, 0.0f, 0.0f);
+                    for (int s = 0; s < samples; ++s) {
+                        color += accum[i * samples + s];
+                    }
+                    color /= static_cast<float>(samples);
+                    color = reinhardToneMapping(color, 1.0f);
+                    if (phong) {
+                        color += scene.backgroundColor;
+                    }
+                    image[pixelIndex[i]] = color;
+                }
+            });
+        }
+    }
+
+private:
+    // Structure of arrays ray queue. weight is the path throughput, pixel is the path's
+    // slot in the batch (pixel * samples + sample) and rng is the path's random state.
+    struct RayQueue {
+        std::vector<float> ox, oy, oz;
+        std::vector<float> dx, dy, dz;
+        std::vector<float> time;
+        std::vector<float> wr, wg, wb;
+        std::vector<uint32_t> pixel;
+        std::vector<int> depth;
+        std::vector<uint32_t> rng;
+
+        size_t size() const {
+            return pixel.size();
+        }
+
+        void resize(size_t n) {
+            for (auto* v : {&ox, &oy, &oz, &dx, &dy, &dz, &time, &wr, &wg, &wb}) {
+                v->resize(n);
+            }
+            pixel.resize(n);
+            depth.resize(n);
+            rng.resize(n);
+        }
+
+        void set(size_t i, const Ray& ray, const Vec3& weight, uint32_t pixelId, int rayDepth, uint32_t rngState) {
+            ox[i] = ray.origin.x; oy[i] = ray.origin.y; oz[i] = ray.origin.z;
+            dx[i] = ray.direction.x; dy[i] = ray.direction.y; dz[i] = ray.direction.z;
+            time[i] = ray.time;
+            wr[i] = weight.x; wg[i] = weight.y; wb[i] = weight.z;
+            pixel[i] = pixelId;
+            depth[i] = rayDepth;
+            rng[i] = rngState;
+        }
+
+        Ray ray(size_t i) const {
+            return Ray(Vec3(ox[i], oy[i], oz[i]), Vec3(dx[i], dy[i], dz[i]), time[i]);
+        }
+
+        Vec3 weight(size_t i) const {
+            return Vec3(wr[i], wg[i], wb[i]);
+        }
+    };
+
+    // One slot per (ray, light); contribution is added to the pixel if the ray is not blocked
+    struct ShadowQueue {
+        std::vector<float> ox, oy, oz;
+        std::vector<float> dx, dy, dz;
+        std::vector<float> time;
+        std::vector<float> cr, cg, cb;
+        std::vector<uint8_t> active;
+        std::vector<uint8_t> visible;
+
+        void resize(size_t n) {
+            for (auto* v : {&ox, &oy, &oz, &dx, &dy, &dz, &time, &cr, &cg, &cb}) {
+                v->resize(n);
+            }
+            active.assign(n, 0);
+            visible.assign(n, 0);
+        }
+    };
+
+    static const size_t chunkSize = 1024;
+    static const int slotBits = 28;  // queues with more spawn slots than this go unsorted
+
+    ThreadPool& pool;
+    size_t batchPaths;
+    RaySort raySort;
+    PathTermination termination;
+    bool sortSecondary;  // decided per render
+    std::vector<uint32_t> pixelIndex;  // batch pixel -> image pixel
+
+    RayQueue rays;
+    RayQueue nextRays;
+    std::vector<uint8_t> hitValid;
+    std::vector<float> hitT;
+    std::vector<PrimitiveRef> hitPrimitive;
+    std::vector<float> directR, directG, directB;  // unshadowed radiance (binary mode)
+    ShadowQueue shadows;
+    size_t lightsPerRay = 0;
+    RayQueue spawned;  // slot i continues the path of ray i
+    std::vector<uint8_t> spawnActive;
+    std::vector<uint64_t> sortKeys, sortKeysTemp;  // coherence key << 28 | slot in spawned
+    std::vector<size_t> chunkOffsets;  // first output slot of each chunk when compacting
+    std::vector<size_t> radixCounts;   // 2048 digit counts per part of the radix sort
+
+    // Runs fn(begin, end) over [0, n) in chunks spread across the pool
+    template <typename Fn>
+    void forChunks(size_t n, Fn fn) {
+        size_t chunks = (n + chunkSize - 1) / chunkSize;
+        pool.parallelFor(chunks, [&](size_t chunk) {
+            size_t begin = chunk * chunkSize;
+            fn(begin, std::min(begin + chunkSize, n));
+        });
+    }
+
+    // Number of parts forParts() splits n items into, one per pool thread unless that
+    // would leave parts smaller than a chunk
+    size_t partCount(size_t n) const {
+        return std::max<size_t>(1, std::min(pool.size(), (n + chunkSize - 1) / chunkSize));
+    }
+
+    // Runs fn(part, begin, end) over [0, n) split into parts contiguous ranges, for
+    // stages that keep per part state
+    template <typename Fn>
+    void forParts(size_t parts, size_t n, Fn fn) {
+        pool.parallelFor(parts, [&](size_t part) {
+            fn(part, n * part / parts, n * (part + 1) / parts);
+        });
+    }
+
+    // Whether the paths of one camera ray can differ, see the top of the file. Binary
+    // mode ends every path at its first hit.
+    bool randomPaths(const Scene& scene, bool phong) const {
+        if (scene.motionBlur) {
+            return true;
+        }
+        if (!phong) {
+            return false;
+        }
+        if (termination.rouletteDepth >= 0) {
+            return true;
+        }
+        auto branches = [](const Material& material) {
+            return material.isreflective && material.reflectivity > 0.0f &&
+                   material.isrefractive && material.refractiveindex > 0.0f;
+        };
+        for (const Sphere& sphere : scene.spheres) {
+            if (branches(sphere.getMaterial())) return true;
+        }
+        for (const Cylinder& cylinder : scene.cylinders) {
+            if (branches(cylinder.getMaterial())) return true;
+        }
+        return std::any_of(scene.materials.begin(), scene.materials.end(), branches);
+    }
+
+    void generate(const PinholeCamera& camera, const TileGrid& tiles, const std::vector<size_t>& batchTiles,
+                  const std::vector<size_t>& offsets, int nbounces, int samples, bool motionBlur, unsigned seed) {
+        TRACE_SCOPE("generate", "wavefront");
+        // With no bounces left computeColor returns black without tracing, the queue
+        // stays empty and only the pixel mapping is filled in
+        bool trace = nbounces > 0;
+        rays.resize(trace ? pixelIndex.size() * samples : 0);
+
+        pool.parallelFor(batchTiles.size(), [&](size_t b) {
+            PinholeCamera::seed(TileGrid::seed(seed, batchTiles[b]));
+            TileRect rect = tiles.rect(batchTiles[b]);
+            size_t slot = offsets[b];
+            for (int j = rect.y0; j < rect.y1; ++j) {
+                for (int i = rect.x0; i < rect.x1; ++i, ++slot) {
+                    float u = static_cast<float>(i) / static_cast<float>(camera.width);
+                    float v = 1.0f - static_cast<float>(j) / static_cast<float>(camera.height);
+                    pixelIndex[slot] = static_cast<uint32_t>(j * camera.width + i);
+                    if (trace) {
+                        // One camera ray, its paths differ in their random state only
+                        Ray ray = camera.generateRay(u, v);
+                        for (int s = 0; s < samples; ++s) {
+                            size_t path = slot * samples + s;
+                            uint32_t rngState = hash(seed ^ hash(pixelIndex[slot] * samples + s));
+                            if (motionBlur) {
+                                // Stratified over the shutter, like renderPixel()
+                                ray.time = (static_cast<float>(s) + nextRandom(rngState)) / samples;
+                            }
+                            rays.set(path, ray, Vec3(1.0f, 1.0f, 1.0f), static_cast<uint32_t>(path), nbounces, rngState);
+                        }
+                    }
+                }
+            }
+            if (trace) {
+                RenderStats::local().primaryRays += (slot - offsets[b]) * samples;
+            }
+        });
+    }
+
+    void extend(const Scene& scene) {
+        TRACE_SCOPE("extend", "wavefront");
+        size_t n = rays.size();
+        hitValid.resize(n);
+        hitT.resize(n);
+        hitPrimitive.resize(n);
+        // Same unbounded range as computeColor, which also takes hits behind the origin
+        const float infinity = std::numeric_limits<float>::infinity();
+        forChunks(n, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                BVHHit hit;
+                hitValid[i] = scene.bvh.intersect(rays.ray(i), -infinity, infinity,
+                                                  scene.spheres, scene.cylinders, scene.triangles, hit);
+                hitT[i] = hit.t;
+                hitPrimitive[i] = hit.primitive;
+            }
+        });
+    }
+
+    void shade(const Scene& scene, int nbounces, bool phong) {
+        TRACE_SCOPE("shade", "wavefront");
+        size_t n = rays.size();
+        lightsPerRay = phong ? scene.lights.size() : 0;
+        shadows.resize(n * lightsPerRay);
+        directR.assign(n, 0.0f);
+        directG.assign(n, 0.0f);
+        directB.assign(n, 0.0f);
+        spawned.resize(n);
+        spawnActive.assign(n, 0);
+
+        forChunks(n, [&](size_t begin, size_t end) {
+            RenderCounters& counters = RenderStats::local();
+            for (size_t i = begin; i < end; ++i) {
+                if (!hitValid[i]) {
+                    continue;
+                }
+                ++counters.shadingCalls;
+
+                Ray ray = rays.ray(i);
+                Vec3 weight = rays.weight(i);
+                Vec3 hit_point = ray.origin + hitT[i] * ray.direction;
+                Vec3 normal;
+                Material material;
+                scene.surfaceAt(hitPrimitive[i], hit_point, ray.time, normal, material);
+
+                if (!phong) {
+                    directR[i] = weight.x;  // binary mode: red
+                    continue;
+                }
+
+                Vec3 ambient = material.ka * material.diffusecolor;
+                for (size_t l = 0; l < lightsPerRay; ++l) {
+                    const PointLight& light = scene.lights[l];
+                    Vec3 light_direction = (light.position - hit_point).normalized();
+                    Vec3 view_direction = (ray.origin - hit_point).normalized();
+                    Vec3 halfway = (view_direction + light_direction).normalized();
+
+                    float diffuse_intensity = std::max(0.0f, Vec3::dot(normal, light_direction));
+                    float specular_intensity = std::pow(std::max(0.0f, Vec3::dot(normal, halfway)), material.specularexponent);
+                    Vec3 diffuse = material.diffusecolor * light.intensity * diffuse_intensity * material.kd;
+                    Vec3 specular = material.specularcolor * light.intensity * specular_intensity * material.ks;
+
+                    // calculateShading's ten light samples all trace this same shadow ray,
+                    // so they pass or fail together with it
+                    float distance_factor = 1.0f / (light.position - hit_point).length_squared();
+                    Vec3 contribution = ambient + diffuse + specular +
+                                        10.0f * (diffuse * distance_factor + specular * distance_factor);
+                    contribution = weight * contribution;
+
+                    size_t s = i * lightsPerRay + l;
+                    Vec3 origin = hit_point + normal * 0.001f;
+                    shadows.ox[s] = origin.x; shadows.oy[s] = origin.y; shadows.oz[s] = origin.z;
+                    shadows.dx[s] = light_direction.x; shadows.dy[s] = light_direction.y; shadows.dz[s] = light_direction.z;
+                    shadows.time[s] = ray.time;
+                    shadows.cr[s] = contribution.x; shadows.cg[s] = contribution.y; shadows.cb[s] = contribution.z;
+                    shadows.active[s] = 1;
+                }
+
+                int childDepth = rays.depth[i] - 1;
+                if (childDepth <= 0) {
+                    continue;  // computeColor stops here as well
+                }
+                uint32_t rngState = rays.rng[i];
+                Ray next = ray;
+                float nextWeight;
+                bool reflected;
+                if (continuePath(ray, hit_point, normal, material, nextRandom(rngState), next, nextWeight, reflected)) {
+                    Vec3 throughput = weight * nextWeight;
+                    if (termination.enabled() && !termination.survives(nbounces - childDepth, throughput, nextRandom(rngState))) {
+                        ++counters.terminatedPaths;
+                        continue;
+                    }
+                    spawned.set(i, next, throughput, rays.pixel[i], childDepth, rngState);
+                    spawnActive[i] = 1;
+                    if (reflected) {
+                        ++counters.reflectionRays;
+                    } else {
+                        ++counters.refractionRays;
+                    }
+                }
+            }
+        });
+    }
+
+    void traceShadows(const Scene& scene) {
+        TRACE_SCOPE("shadow", "wavefront");
+        forChunks(shadows.active.size(), [&](size_t begin, size_t end) {
+            uint64_t traced = 0;
+            for (size_t s = begin; s < end; ++s) {
+                if (!shadows.active[s]) {
+                    continue;
+                }
+                ++traced;
+                Ray shadow_ray(Vec3(shadows.ox[s], shadows.oy[s], shadows.oz[s]),
+                               Vec3(shadows.dx[s], shadows.dy[s], shadows.dz[s]), shadows.time[s]);
+                shadows.visible[s] = !scene.bvh.occluded(shadow_ray, 0.001f, 1.0f,
+                                                         scene.spheres, scene.cylinders, scene.triangles);
+            }
+            RenderStats::local().shadowRays += traced;
+        });
+    }
+
+    // Paths continue one ray at a time and every path has its own slot, so no two rays
+    // of the queue share one and the chunks never write the same one
+    void accumulate(std::vector<Vec3>& accum) {
+        TRACE_SCOPE("accumulate", "wavefront");
+        forChunks(rays.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                Vec3& pixel = accum[rays.pixel[i]];
+                pixel += Vec3(directR[i], directG[i], directB[i]);
+                for (size_t l = 0; l < lightsPerRay; ++l) {
+                    size_t s = i * lightsPerRay + l;
+                    if (shadows.active[s] && shadows.visible[s]) {
+                        pixel += Vec3(shadows.cr[s], shadows.cg[s], shadows.cb[s]);
+                    }
+                }
+            }
+        });
+    }
+
+    // Integer hash (the murmur3 finaliser)
+    static uint32_t hash(uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x85ebca6bu;
+        x ^= x >> 13;
+        x *= 0xc2b2ae35u;
+        x ^= x >> 16;
+        return x;
+    }
+
+    // Uniform float in [0, 1) from a ray's random state, advancing it
+    static float nextRandom(uint32_t& state) {
+        state = state * 747796405u + 2891336453u;
+        return (hash(state) >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // Spreads the low 10 bits of v so two zero bits follow each one
+    static uint32_t spreadBits(uint32_t v) {
+        v &= 0x3ff;
+        v = (v | (v << 16)) & 0x030000ff;
+        v = (v | (v << 8)) & 0x0300f00f;
+        v = (v | (v << 4)) & 0x030c30c3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    // Direction octant in the top 3 bits, then a 30 bit Morton code of the origin inside
+    // the scene bounds. Rays with the same key head the same way from the same region
+    // and mostly visit the same BVH nodes.
+    static uint64_t coherenceKey(const Ray& ray, const AABB& bounds) {
+        uint32_t octant = (ray.direction.x < 0.0f ? 4u : 0u) | (ray.direction.y < 0.0f ? 2u : 0u) |
+                          (ray.direction.z < 0.0f ? 1u : 0u);
+        auto cell = [](float v, float lo, float hi) {
+            float f = hi > lo ? (v - lo) / (hi - lo) : 0.0f;
+            return static_cast<uint32_t>(std::min(std::max(f, 0.0f), 1.0f) * 1023.0f);
+        };
+        uint32_t morton = (spreadBits(cell(ray.origin.x, bounds.min.x, bounds.max.x)) << 2) |
+                          (spreadBits(cell(ray.origin.y, bounds.min.y, bounds.max.y)) << 1) |
+                          spreadBits(cell(ray.origin.z, bounds.min.z, bounds.max.z));
+        return (static_cast<uint64_t>(octant) << 30) | morton;
+    }
+
+    // LSD radix sort on the 33 key bits above the slot, three passes of 11 bits. Every
+    // part counts its own digits and scatters its own items; taking the offsets digit
+    // by digit, part by part, keeps the sort stable.
+    void radixSort(std::vector<uint64_t>& items) {
+        size_t n = items.size();
+        size_t parts = partCount(n);
+        sortKeysTemp.resize(n);
+        radixCounts.resize(parts * 2048);
+        for (int shift = slotBits; shift < slotBits + 33; shift += 11) {
+            forParts(parts, n, [&](size_t part, size_t begin, size_t end) {
+                size_t* counts = &radixCounts[part * 2048];
+                std::fill(counts, counts + 2048, size_t(0));
+                for (size_t k = begin; k < end; ++k) {
+                    ++counts[(items[k] >> shift) & 2047];
+                }
+            });
+            size_t total = 0;
+            for (size_t digit = 0; digit < 2048; ++digit) {
+                for (size_t part = 0; part < parts; ++part) {
+                    size_t& count = radixCounts[part * 2048 + digit];
+                    size_t c = count;
+                    count = total;
+                    total += c;
+                }
+            }
+            forParts(parts, n, [&](size_t part, size_t begin, size_t end) {
+                size_t* offsets = &radixCounts[part * 2048];
+                for (size_t k = begin; k < end; ++k) {
+                    sortKeysTemp[offsets[(items[k] >> shift) & 2047]++] = items[k];
+                }
+            });
+            items.swap(sortKeysTemp);
+        }
+    }
+
+    void spawn(const Scene& scene) {
+        TRACE_SCOPE("spawn", "wavefront");
+        // Compact the continuing slots: count them per chunk, a prefix sum over the
+        // chunks gives each its first output slot, then every chunk writes its own
+        size_t n = spawnActive.size();
+        chunkOffsets.assign((n + chunkSize - 1) / chunkSize + 1, 0);
+        forChunks(n, [&](size_t begin, size_t end) {
+            chunkOffsets[begin / chunkSize + 1] = static_cast<size_t>(
+                std::count(spawnActive.begin() + begin, spawnActive.begin() + end, uint8_t(1)));
+        });
+        for (size_t c = 1; c < chunkOffsets.size(); ++c) {
+            chunkOffsets[c] += chunkOffsets[c - 1];
+        }
+        sortKeys.resize(chunkOffsets.back());
+        forChunks(n, [&](size_t begin, size_t end) {
+            size_t out = chunkOffsets[begin / chunkSize];
+            for (size_t i = begin; i < end; ++i) {
+                if (spawnActive[i]) {
+                    sortKeys[out++] = static_cast<uint64_t>(i);
+                }
+            }
+        });
+
+        if (sortSecondary && sortKeys.size() > 1 && spawnActive.size() < (size_t(1) << slotBits)) {
+            TRACE_SCOPE("sort", "wavefront");
+            AABB bounds = scene.bvh.bounds();
+            forChunks(sortKeys.size(), [&](size_t begin, size_t end) {
+                for (size_t k = begin; k < end; ++k) {
+                    sortKeys[k] |= coherenceKey(spawned.ray(sortKeys[k]), bounds) << slotBits;
+                }
+            });
+            radixSort(sortKeys);
+        }
+
+        nextRays.resize(sortKeys.size());
+        forChunks(sortKeys.size(), [&](size_t begin, size_t end) {
+            for (size_t out = begin; out < end; ++out) {
+                size_t i = static_cast<size_t>(sortKeys[out] & ((uint64_t(1) << slotBits) - 1));
+                nextRays.set(out, spawned.ray(i), spawned.weight(i), spawned.pixel[i], spawned.depth[i], spawned.rng[i]);
+            }
+        });
+        std::swap(rays, nextRays);
+    }
+};
+
+#endif // WAVEFRONT_H